@@ -4,7 +4,7 @@ using namespace MuCplGen;
 int main()
 {
 	EasyScanner easyScanner;
-	easyScanner.SetKeyword(std::regex("^(int|float|color|sampler|vec2|vec3|vec4|bool|true|false)"));
+	easyScanner.SetKeyword({ "int", "float", "color", "sampler", "vec2", "vec3", "vec4", "bool", "true", "false" });
 	VariableReader reader;
 	reader.Build();
 
@@ -12,6 +12,12 @@ public:
 		generation_option = BuildOption::LoadAndSave;
 		SetStorage("./storage/Calculator.bin");
 
+		// the actions are checked against these types by Build(), and read their arguments without type checks
+		DeclareType<float>("E");
+		DeclareType<float>("T");
+		DeclareType<float>("P");
+		DeclareType<float>("F");
+
 		{
 			//translate number token as terminator "num"
 			auto& t = CreateTerminator("num");
@@ -19,6 +19,7 @@ public:
 		//bTy->keyword && "int";
 		{
 			auto& t = CreateTerminator("bTy");
+			t.tokenTypes = { Token::TokenType::keyword };
 			t.translation = [this](const Token& token)
 			{
 				if (token.type == Token::TokenType::keyword)
@@ -36,6 +37,7 @@ public:
 		//record->keyword && "class";
 		{
 			auto& t = CreateTerminator("record");
+			t.tokenTypes = { Token::TokenType::keyword };
 			t.translation = [this](const Token& token)
 			{
 				if (token.type == Token::TokenType::keyword)
@@ -49,6 +51,7 @@ public:
 		//str->raw_string;
 		{
 			auto& t = CreateTerminator("str");
+			t.tokenTypes = { Token::TokenType::raw_string };
 			t.translation = [this](const Token& token)
 			{
 				return token.type == Token::TokenType::raw_string;
@@ -58,6 +61,7 @@ public:
 		//num->number;
 		{
 			auto& t = CreateTerminator("num");
+			t.tokenTypes = { Token::TokenType::number };
 			t.translation = [this](const Token& token)
 			{
 				return token.type == Token::TokenType::number;
@@ -67,6 +71,7 @@ public:
 		//id->identifier;
 		{
 			auto& t = CreateTerminator("id");
+			t.tokenTypes = { Token::TokenType::identifier };
 			t.translation = [this](const Token& token)
 			{
 				return token.type == Token::TokenType::identifier;
@@ -75,6 +80,7 @@ public:
 		//cTy->custom_type;
 		{
 			auto& t = CreateTerminator("cTy");
+			t.tokenTypes = { Token::TokenType::custom_type };
 			t.translation = [this](const Token& token)
 			{
 				return token.type == Token::TokenType::custom_type;
@@ -83,6 +89,7 @@ public:
 		//rel->rel_op;
 		{
 			auto& t = CreateTerminator("rel");
+			t.tokenTypes = { Token::TokenType::rel_op };
 			t.translation = [this](const Token& token)
 			{
 				return token.type == Token::TokenType::rel_op;
@@ -92,6 +99,7 @@ public:
 		//bl->keyword && "false";
 		{
 			auto& t = CreateTerminator("bl");
+			t.tokenTypes = { Token::TokenType::keyword };
 			t.translation = [this](const Token& token)
 			{
 				if (token.type == Token::TokenType::keyword)
@@ -921,7 +929,7 @@ public:
 	{
 		if (error_info_pair.size())
 		{
-			Debug::Highlight(GetInputText(), GetTokenSet(), error_info_pair);
+			Debug::Highlight(*GetInputSource(), GetTokenSet(), error_info_pair);
 			return true;
 		}
 		return false;
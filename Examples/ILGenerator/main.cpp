@@ -10,19 +10,21 @@ using namespace MuCplGen;
 int main()
 {
 
-	auto input_text = FileLoader::Load("assignment_test.txt");
+	auto source = FileLoader::Map("assignment_test.txt");
 	
 	StopWatch total;
 	total.Start();
 	StopWatch scanner_build_time;
 	scanner_build_time.Start();
 	EasyScanner easyScanner;
+	easyScanner.engine = ScannEngine::DFA;
+	easyScanner.CompileDFA();
 	scanner_build_time.Stop();
 
 	StopWatch scann_time;
 	scann_time.Start();
-	auto token_set = easyScanner.Scann(input_text);
-	Debug::Highlight(input_text, token_set);
+	auto scann_result = easyScanner.ScannSource(source);
+	Debug::Highlight(scann_result);
 	scann_time.Stop();
 	
 	StopWatch parser_build_time;
@@ -33,7 +35,7 @@ int main()
 
 	StopWatch parse_time;
 	parse_time.Start();
-	ILGen.Parse(input_text, token_set);
+	ILGen.Parse(scann_result);
 	ILGen.HighlightIfHasError();
 	//ILGen.ShowILCode();
 	//ILGen.ShowTables();
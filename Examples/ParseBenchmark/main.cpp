@@ -0,0 +1,94 @@
+#include <iostream>
+#include <sstream>
+#include <MuCplGen/MuCplGen.h>
+#include <MuCplGen/DebugTool/StopWatch.h>
+using namespace MuCplGen;
+
+// the same expression grammar and tokens parsed through the std::function entry point
+// and through the templated one, which lets the compiler inline the callbacks
+//
+// S_ -> E
+// E -> E + T | T
+// T -> T * F | F
+// F -> ( E ) | num
+enum Symbol : size_t
+{
+	S_, E, T, F,
+	epsilon,
+	plus, times, left, right, num,
+	end
+};
+
+Symbol Transfer(const EasyToken& token)
+{
+	if (token.IsEndToken()) return end;
+	if (token.type == EasyToken::TokenType::number) return num;
+	switch (token.name[0])
+	{
+	case '+': return plus;
+	case '*': return times;
+	case '(': return left;
+	case ')': return right;
+	}
+	throw(Exception("Unexpected token: " + token.name));
+}
+
+int main()
+{
+	PushDownAutomaton<size_t>::ProductionTable productions =
+	{
+		{ { E } },
+		{ { E, plus, T }, { T } },
+		{ { T, times, F }, { F } },
+		{ { left, E, right }, { num } },
+	};
+	SLRParser<EasyToken> parser(productions, (size_t)num, (size_t)end, (size_t)epsilon, (size_t)S_);
+
+	std::stringstream ss;
+	for (size_t i = 0; i < 100000; ++i) ss << "(1+2)*3*(4+5*6)+";
+	ss << "7";
+	EasyScanner scanner;
+	scanner.engine = ScannEngine::DFA;
+	auto tokens = scanner.ScannSource(ss.str()).tokens;
+	std::cout << "tokens=" << tokens.size() << std::endl;
+
+	const size_t rounds = 5;
+	size_t reductions = 0;
+	bool accepted = true;
+
+	StopWatch function_time;
+	function_time.Start();
+	for (size_t i = 0; i < rounds; ++i)
+	{
+		parser.Reset();
+		accepted &= parser.Parse(tokens,
+			SLRParser<EasyToken>::TransferFunc([](const EasyToken& token) { return (size_t)Transfer(token); }),
+			SLRParser<EasyToken>::SemanticAction([&reductions](Span<std::any*>, size_t, size_t, size_t) -> std::any*
+				{
+					++reductions;
+					return nullptr;
+				}),
+			SLRParser<EasyToken>::ErrorFunc([](std::vector<size_t>, size_t) {}));
+	}
+	function_time.Stop();
+
+	StopWatch template_time;
+	template_time.Start();
+	for (size_t i = 0; i < rounds; ++i)
+	{
+		parser.Reset();
+		accepted &= parser.Parse(tokens,
+			[](const EasyToken& token) { return (size_t)Transfer(token); },
+			[&reductions](Span<std::any*>, size_t, size_t, size_t) -> std::any*
+			{
+				++reductions;
+				return nullptr;
+			},
+			[](std::vector<size_t>, size_t) {});
+	}
+	template_time.Stop();
+
+	std::cout << "accepted=" << accepted << " reductions=" << reductions << std::endl;
+	std::cout << "std::function parse=" << function_time << std::endl;
+	std::cout << "templated parse=" << template_time << std::endl;
+}
@@ -0,0 +1,53 @@
+#include <iostream>
+#include <sstream>
+#include <MuCplGen/MuCplGen.h>
+using namespace MuCplGen;
+
+// ScannSource must split lines like the legacy Scann (std::getline):
+// a trailing '\n' is not part of the last line, so a rule anchored with '^' still matches there
+std::vector<LineContent> GetLines(const std::string& text)
+{
+	std::vector<LineContent> lines;
+	std::stringstream ss(text);
+	std::string line;
+	size_t line_no = 1;
+	while (std::getline(ss, line)) lines.push_back({ line, line_no++ });
+	return lines;
+}
+
+bool CheckLineCount(const std::string& text)
+{
+	auto source = InputSource::Own(text);
+	auto same = source->LineCount() == GetLines(text).size();
+	for (size_t i = 0; same && i < source->LineCount(); ++i)
+		same = source->Line(i) == GetLines(text)[i].content;
+	return same;
+}
+
+bool CheckScann(const std::string& text, ScannEngine engine)
+{
+	Scanner<> scanner;
+	scanner.engine = engine;
+	auto& r = scanner.CreateRule();
+	r.tokenType = "word";
+	r.expression = "^[a-z]+";
+	auto expected = scanner.Scann(GetLines(text));
+	auto tokens = scanner.ScannSource(InputSource::Own(text)).tokens;
+	if (tokens.size() != expected.size()) return false;
+	for (size_t i = 0; i < tokens.size(); ++i)
+		if (tokens[i].name != expected[i].name || tokens[i].line != expected[i].line) return false;
+	return true;
+}
+
+int main()
+{
+	auto ok = true;
+	for (auto text : { "a\n", "a\n\n", "ab\ncd", "ab\ncd\n" })
+	{
+		auto same = CheckLineCount(text)
+			&& CheckScann(text, ScannEngine::Regex) && CheckScann(text, ScannEngine::DFA);
+		std::cout << (same ? "same" : "different") << std::endl;
+		ok &= same;
+	}
+	return ok ? 0 : 1;
+}
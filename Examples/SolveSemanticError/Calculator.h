@@ -91,16 +91,10 @@ public:
 			p.action_name = "Divid()";
 			p.expression = "T -> T / P";
 			p.SetAction(
-				[this](float T, Empty, float P)->float
+				[this](float T, Empty, float P)->SemanticResult<float>
 				{
-					
-					if (P == 0.0)
-					{
-						SemanticError se;
-						se.error_data.code = ParserErrorCode::SemanticError;
-						se.error_data.data = std::string("Error: Div 0");
-						throw(se);
-					}
+					// same as throwing a SemanticError with this error_data, without the exception
+					if (P == 0.0) return SemanticResult<float>::Error(std::string("Error: Div 0"));
 					return T / P;
 				});
 		}
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace MuCplGen
+{
+	// a fixed size set of small indices, e.g. the lookahead terms of an LR1 item
+	class BitSet
+	{
+	public:
+		BitSet() = default;
+		explicit BitSet(size_t size) : words((size + 63) / 64, 0), size(size) {}
+
+		size_t Size() const { return size; }
+
+		bool Test(size_t i) const { return (words[i / 64] >> (i % 64)) & 1; }
+		void Set(size_t i) { words[i / 64] |= (uint64_t)1 << (i % 64); }
+		void Reset(size_t i) { words[i / 64] &= ~((uint64_t)1 << (i % 64)); }
+
+		bool Any() const
+		{
+			for (auto word : words) if (word) return true;
+			return false;
+		}
+
+		// this |= rhs, true if any bit is new, rhs may be shorter
+		bool Merge(const BitSet& rhs)
+		{
+			uint64_t changed = 0;
+			auto count = words.size() < rhs.words.size() ? words.size() : rhs.words.size();
+			for (size_t i = 0; i < count; ++i)
+			{
+				changed |= rhs.words[i] & ~words[i];
+				words[i] |= rhs.words[i];
+			}
+			return changed != 0;
+		}
+
+		// calls f(i) for every i in the set, in ascending order
+		template<class F>
+		void ForEach(F&& f) const
+		{
+			for (size_t w = 0; w < words.size(); ++w)
+				for (auto word = words[w]; word; word &= word - 1)
+				{
+					size_t bit = 0;
+					while (!((word >> bit) & 1)) ++bit;
+					f(w * 64 + bit);
+				}
+		}
+
+		size_t Hash() const
+		{
+			size_t h = size;
+			for (auto word : words) h = h * 1099511628211ull ^ (size_t)word;
+			return h;
+		}
+
+		bool operator == (const BitSet& rhs) const { return size == rhs.size && words == rhs.words; }
+		bool operator != (const BitSet& rhs) const { return !(*this == rhs); }
+
+	private:
+		std::vector<uint64_t> words;
+		size_t size = 0;
+	};
+}
@@ -6,14 +6,20 @@
 #include <functional>
 #include <stack>
 #include <type_traits>
+#include <typeindex>
+#include <variant>
 #include "Parser.h"
 #include "MuException.h"
 #include "FunctionDeduce.h"
+#include "SemanticPool.h"
 
 namespace MuCplGen
 {
 	struct Empty {};
 
+	// the values of a production body as semantic actions see them, in place on the parser's semantic stack
+	using SemanticValues = Span<std::any* const>;
+
 	struct PassOn
 	{
 		PassOn(int i = 0) : index(i) {}
@@ -31,6 +37,63 @@ namespace MuCplGen
 		virtual ~SemanticError() override {}
 	};
 
+	// return it from a semantic action to report an error without throwing SemanticError, e.g.
+	// if (P == 0.0) return SemanticResult<float>::Error(std::string("Div 0"));
+	template<class T>
+	class SemanticResult
+	{
+	public:
+		SemanticResult(T value) : result(std::in_place_index<0>, std::move(value)) {}
+		SemanticResult(ParserErrorData error) : result(std::in_place_index<1>, std::move(error)) {}
+
+		static SemanticResult Error(std::any data = {}, ParserErrorCode code = ParserErrorCode::SemanticError)
+		{
+			ParserErrorData error;
+			error.code = code;
+			error.data = std::move(data);
+			return SemanticResult(std::move(error));
+		}
+
+		bool HasError() const { return result.index() == 1; }
+		T& Value() { return std::get<0>(result); }
+		ParserErrorData& ErrorData() { return std::get<1>(result); }
+
+	private:
+		std::variant<T, ParserErrorData> result;
+	};
+
+	template<class T>
+	struct IsSemanticResult : std::false_type { using Value = T; };
+
+	template<class T>
+	struct IsSemanticResult<SemanticResult<T>> : std::true_type { using Value = T; };
+
+	// what Terminator::tokenTypes holds: Token::TokenType for tokens that have one (e.g. EasyToken::type),
+	// the kind of CompactToken, nothing to index for other tokens
+	template<class Token, class = void>
+	struct TerminatorKind
+	{
+		using Kind = int;
+		static constexpr bool indexed = false;
+		static size_t Of(const Token&) { return 0; }
+	};
+
+	template<class Token>
+	struct TerminatorKind<Token, std::void_t<typename Token::TokenType, decltype(std::declval<const Token&>().type)>>
+	{
+		using Kind = typename Token::TokenType;
+		static constexpr bool indexed = true;
+		static size_t Of(const Token& token) { return (size_t)token.type; }
+	};
+
+	template<>
+	struct TerminatorKind<CompactToken>
+	{
+		using Kind = uint16_t;
+		static constexpr bool indexed = true;
+		static size_t Of(const CompactToken& token) { return token.kind; }
+	};
+
 	template<class UserToken, class T = size_t>
 	struct Terminator
 	{
@@ -42,6 +105,8 @@ namespace MuCplGen
 		std::string name;
 		int priority = 0;
 		std::function<bool(const Token&)> translation;
+		// if not empty, translation only accepts tokens of these types and is not tried on others
+		std::vector<typename TerminatorKind<Token>::Kind> tokenTypes;
 		std::string ScopedName(const std::string& name)
 		{
 			if (scope.empty()) return name;
@@ -50,17 +115,20 @@ namespace MuCplGen
 		}
 	private:
 		T sym;
+		// made by SyntaxDirected for a literal in a production body
+		bool wild = false;
 	};
 
 	struct ParseRule
 	{
 		template<class Parser>
 		friend class SyntaxDirected;
+		friend class BaseSyntaxDirected;
 		std::string action_name;
 		std::string expression;
 		std::string scope;
 		//std::vector<std::string> scopes;
-		using SemanticAction = std::function<std::any* (std::vector<std::any*>)>;
+		using SemanticAction = std::function<std::any* (SemanticValues)>;
 		std::string head;
 		std::vector<std::string> body;
 		std::string fullname_expression;
@@ -102,14 +170,22 @@ namespace MuCplGen
 		template<class Ret>
 		void SetSemanticErrorAction(std::function<Ret(const std::vector<std::any*>&)> on_error)
 		{
-			semantic_error = [on_error, this](std::vector<std::any*> data)->std::any*
+			// only called on errors, so the values are copied out for on_error
+			semantic_error = [on_error, this](SemanticValues data)->std::any*
 			{
-				return RecordRet(on_error(data), data);
+				return RecordRet(on_error(data.ToVector()), data);
 			};
+			error_ret_type = typeid(std::decay_t<Ret>);
 		}
 
 		template<class Arg>
 		Arg GetArg(const std::vector<std::any*>& data, int index)
+		{
+			return GetArg<Arg>(SemanticValues(data), index);
+		}
+
+		template<class Arg>
+		Arg GetArg(SemanticValues data, int index)
 		{
 			if (index >= data.size())
 			{
@@ -123,9 +199,9 @@ namespace MuCplGen
 			auto arg = data[index];
 			if (arg == nullptr)
 			{
-				if constexpr (std::is_same_v<std::remove_reference<Arg>::type, Empty>)
-					return Empty{};
-				std::string name = typeid(typename std::remove_reference<Arg>::type).name();
+				if constexpr (std::is_same_v<std::decay_t<Arg>, Empty>)
+					return EmptyArg();
+				std::string name = typeid(std::remove_reference_t<Arg>).name();
 				std::stringstream ss;
 				ss << "Unmatched Type!"
 					<< "Parser Rule=" << this->action_name << std::endl
@@ -149,38 +225,57 @@ namespace MuCplGen
 		}
 	private:
 		int current_arg = -1;
-		void BeginArgs(const std::vector<std::any*>& data) { current_arg = data.size(); }
+		void BeginArgs(SemanticValues data) { current_arg = data.size(); }
 
 		template<class Arg>
-		Arg GetArg(const std::vector<std::any*>& data)
+		Arg GetArg(SemanticValues data)
 		{
+			if (typed) return TypedArg<Arg>(data, --current_arg);
 			return GetArg<Arg>(data, --current_arg);
 		}
+
+		// the types were checked by Build, and a value is read by one reduction only, so it is moved out
+		template<class Arg>
+		Arg TypedArg(SemanticValues data, int index)
+		{
+			using Value = std::decay_t<Arg>;
+			if constexpr (std::is_same_v<Value, Empty>) return EmptyArg();
+			else if constexpr (std::is_reference_v<Arg>) return *std::any_cast<Value>(data[index]);
+			else return std::move(*std::any_cast<Value>(data[index]));
+		}
+
+		// an Empty parameter may be taken by reference
+		static Empty& EmptyArg()
+		{
+			static Empty empty;
+			return empty;
+		}
+
 		template<class Ret>
-		std::any* RecordRet(Ret&& ret, const std::vector<std::any*>& data)
+		std::any* RecordRet(Ret&& ret, SemanticValues data)
 		{
 			if constexpr(std::is_null_pointer_v<Ret>) return nullptr;
-			if constexpr (std::is_same_v<PassOn, std::remove_reference<Ret>::type>) return data[ret.index];
-			auto* o = new std::any;
-			o->emplace<Ret>(std::forward<Ret>(ret));
-			gc.push(o);
-			return o;
+			if constexpr (std::is_same_v<PassOn, std::remove_reference_t<Ret>>) return data[ret.index];
+			if (pool == nullptr) throw(Exception("ParseRule is not created by a SyntaxDirected"));
+			return pool->Emplace(std::forward<Ret>(ret));
 		}
 
-		std::stack<std::any*> gc;
-		SemanticAction semantic_action = [this](std::vector<std::any*> data) { return data[0]; };
+		// the values of a parse, owned by the SyntaxDirected and reset after every parse
+		SemanticPool* pool = nullptr;
+		SemanticAction semantic_action = [this](SemanticValues data) { return data[0]; };
 		SemanticAction semantic_error;
 
-	public:
-		~ParseRule()
-		{
-			while (!gc.empty())
-			{
-				delete gc.top();
-				gc.pop();
-			}
-		}
+		// what the action takes and returns, for the checks of SyntaxDirected::DeclareType
+		// void: no action, the value is nullptr
+		std::vector<std::type_index> arg_types;
+		std::type_index ret_type = typeid(void);
+		std::type_index error_ret_type = typeid(void);
+		// the body value passed on, -1 if the action makes the value
+		int pass_on = 0;
+		// set by Build once the types of every argument are checked
+		bool typed = false;
 
+	public:
 		template <class F, class Op = decltype(&F::operator())>
 		void SetAction(F action)
 		{
@@ -191,12 +286,18 @@ namespace MuCplGen
 		{
 			if (ptr != nullptr) throw(Exception("ptr must be nullptr"));
 			semantic_action = nullptr;
+			arg_types.clear();
+			ret_type = typeid(void);
+			pass_on = -1;
 		}
 
 		void SetAction(const PassOn& passon)
 		{
 			int index = passon.index;
-			semantic_action = [this, index = passon.index](std::vector<std::any*> data) { return data[index]; };
+			semantic_action = [this, index = passon.index](SemanticValues data) { return data[index]; };
+			arg_types.clear();
+			ret_type = typeid(void);
+			pass_on = index;
 		}
 
 		template<class T>
@@ -209,27 +310,33 @@ namespace MuCplGen
 			template<class T>
 			static void Set(ParseRule* pr, T&& action)
 			{
-				pr->semantic_action = [action, pr](std::vector<std::any*> data)->std::any*
+				pr->semantic_action = [action, pr](SemanticValues data)->std::any*
 				{
 					pr->BeginArgs(data);
 					static_assert(!std::is_same_v<Ret,void>, 
 						"Your Semantic Action has no return, "
 						"return Empty{},if you have nothing to pass on");
-					Ret ret;
-					bool error = false;
-					SemanticError se;
-					try
+					if constexpr (IsSemanticResult<Ret>::value)
 					{
-						ret = action(pr->GetArg<Args>(data)...);
+						auto result = action(pr->GetArg<Args>(data)...);
+						if (result.HasError()) return pr->RecordRet(std::move(result.ErrorData()), data);
+						return pr->RecordRet(std::move(result.Value()), data);
 					}
-					catch (SemanticError e)
+					else
 					{
-						error = true;
-						se = e;
+						try
+						{
+							return pr->RecordRet(action(pr->GetArg<Args>(data)...), data);
+						}
+						catch (const SemanticError& e)
+						{
+							return pr->RecordRet(e.error_data, data);
+						}
 					}
-					if (!error) return pr->RecordRet(ret, data);
-					else return pr->RecordRet(se.error_data, data);
 				};
+				pr->arg_types = { std::type_index(typeid(std::decay_t<Args>))... };
+				pr->ret_type = typeid(std::decay_t<typename IsSemanticResult<Ret>::Value>);
+				pr->pass_on = -1;
 			}
 		};
 	};
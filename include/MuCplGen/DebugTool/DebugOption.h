@@ -15,10 +15,11 @@ namespace MuCplGen::Debug
 		ParserDetail = 1 << 7,
 		ParserError = 1 << 8,
 		SyntaxError = 1 << 9,
+		ShowParseTableSize = 1 << 10,
 
 		AllDebugInfo = HighlightSyntaxFile | SyntaxFileProcessStage | ShowProductionTable
 		| ShowCatchedVariables | ShowCatchedWildTerminator | SyntaxFileSemanticCheck
-		| ShowReductionProcess | ParserDetail | ParserError | SyntaxError,
+		| ShowReductionProcess | ParserDetail | ParserError | SyntaxError | ShowParseTableSize,
 
 		ConciseInfo = SyntaxFileProcessStage | ParserError | SyntaxError
 	};
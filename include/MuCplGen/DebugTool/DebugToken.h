@@ -4,8 +4,12 @@
 
 namespace MuCplGen::Debug
 {
-	struct DebugToken :public BaseToken
+	template<class Base = BaseToken>
+	struct BasicDebugToken :public Base
 	{
 		ConsoleForegroundColor color = ConsoleForegroundColor::White;
 	};
+
+	using DebugToken = BasicDebugToken<BaseToken>;
+	using DebugViewToken = BasicDebugToken<ViewToken>;
 }
\ No newline at end of file
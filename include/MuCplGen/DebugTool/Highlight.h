@@ -5,31 +5,35 @@
 #include <type_traits>
 #include "ColoredText.h"
 #include "../LineContent.h"
+#include "../InputSource.h"
 #include "DebugToken.h"
+#include "../Scanner.h"
 
 
 namespace MuCplGen::Debug
 {
-	template<typename Token = DebugToken>
-	void Highlight(std::vector<LineContent>& input_text, std::vector<Token>& token_set,
-		const std::vector<std::pair<size_t, std::string>>& error_info_pair, std::ostream& log = std::cout)
+	// line_at(i) gives the i-th line as LineView
+	template<typename Token, typename LineAt>
+	void HighlightLines(size_t line_count, LineAt line_at, const std::vector<Token>& token_set,
+		const std::vector<std::pair<size_t, std::string>>& error_info_pair, std::ostream& log)
 	{
-		static_assert(std::is_base_of<DebugToken, Token>::value, "To Highlight, your token should derived from DebugToken");
+		static_assert(std::is_base_of<BasicDebugToken<BasicToken<typename Token::TextType>>, Token>::value, "To Highlight, your token should derived from DebugToken");
 		if ((&log) != (&std::cout)) { log << "[token highlight only validates with std::cout]"; }
 		SetConsoleColor(log, ConsoleForegroundColor::White);
 		auto error = false;
 		size_t error_iter = 0;
 		size_t start = 0;
-		if (input_text.size())
-			start = input_text[0].line_no;
+		if (line_count)
+			start = line_at(0).line_no;
 		size_t token_iter = 0;
-		for (size_t i = 0; i < input_text.size(); i++)
+		for (size_t i = 0; i < line_count; i++)
 		{
+			auto line = line_at(i);
 			SetConsoleColor(log, ConsoleForegroundColor::White);
-			log << "[" << input_text[i].line_no << "\t]";
+			log << "[" << line.line_no << "\t]";
 			size_t j = 0;
 			bool over = false;
-			while (j < input_text[i].content.size())
+			while (j < line.content.size())
 			{
 				if (token_iter >= token_set.size())
 					over = true;
@@ -40,14 +44,14 @@ namespace MuCplGen::Debug
 						&& token_set[token_iter].start <= j)
 					{
 						SetConsoleColor(log, token_set[token_iter].color);
-						log << input_text[i].content[j];
+						log << line.content[j];
 						++j;
 					}
 					else if (i == token_set[token_iter].line - start && j < token_set[token_iter].start
 						|| i < token_set[token_iter].line - start)
 					{
 						SetConsoleColor(log, ConsoleForegroundColor::Green);
-						log << input_text[i].content[j];
+						log << line.content[j];
 						++j;
 					}
 					else if (i == token_set[token_iter].line - start && j > token_set[token_iter].end
@@ -61,7 +65,7 @@ namespace MuCplGen::Debug
 				else
 				{
 					SetConsoleColor(log, ConsoleForegroundColor::Green);
-					log << input_text[i].content[j];
+					log << line.content[j];
 					++j;
 				}
 			}
@@ -69,7 +73,7 @@ namespace MuCplGen::Debug
 			if (error)
 			{
 				SetConsoleColor(log, ConsoleForegroundColor::Red);
-				log << "[" << input_text[i].line_no << "\t]";
+				log << "[" << line.line_no << "\t]";
 				for (size_t t = 0; t < token_set[error_info_pair[error_iter].first].start; ++t)
 					log << " ";
 				log << "^" << error_info_pair[error_iter++].second << std::endl;
@@ -81,15 +85,83 @@ namespace MuCplGen::Debug
 	}
 
 	template<typename Token = DebugToken>
-	void Highlight(std::vector<LineContent>& input_text, std::vector<Token>& token_set, std::ostream& log = std::cout)
+	void Highlight(const std::vector<LineContent>& input_text, const std::vector<Token>& token_set,
+		const std::vector<std::pair<size_t, std::string>>& error_info_pair, std::ostream& log = std::cout)
+	{
+		HighlightLines(input_text.size(),
+			[&](size_t i) { return LineView{ input_text[i].content, input_text[i].line_no }; },
+			token_set, error_info_pair, log);
+	}
+
+	template<typename Token = DebugToken>
+	void Highlight(const InputSource& source, const std::vector<Token>& token_set,
+		const std::vector<std::pair<size_t, std::string>>& error_info_pair, std::ostream& log = std::cout)
+	{
+		HighlightLines(source.LineCount(),
+			[&](size_t i) { return LineView{ source.Line(i), source.FirstLineNo() + i }; },
+			token_set, error_info_pair, log);
+	}
+
+	template<typename Token = DebugToken>
+	void Highlight(const std::vector<LineContent>& input_text, const std::vector<Token>& token_set, std::ostream& log = std::cout)
 	{
 		Highlight(input_text, token_set, {}, log);
 	}
 
 	template<typename Token = DebugToken>
-	void Highlight(std::vector<LineContent>& input_text, std::vector<Token>& token_set,
+	void Highlight(const std::vector<LineContent>& input_text, const std::vector<Token>& token_set,
 		size_t error_iter,const std::string& error_info, std::ostream& log = std::cout)
 	{
 		Highlight(input_text, token_set, { {error_iter, error_info} }, log);
 	}
-}
+
+	template<typename Token = DebugToken>
+	void Highlight(const InputSource& source, const std::vector<Token>& token_set, std::ostream& log = std::cout)
+	{
+		Highlight(source, token_set, {}, log);
+	}
+
+	template<typename Token = DebugToken>
+	void Highlight(const ScannResult<Token>& result,
+		const std::vector<std::pair<size_t, std::string>>& error_info_pair, std::ostream& log = std::cout)
+	{
+		Highlight(*result.source, result.tokens, error_info_pair, log);
+	}
+
+	template<typename Token = DebugToken>
+	void Highlight(const ScannResult<Token>& result, std::ostream& log = std::cout)
+	{
+		Highlight(result, {}, log);
+	}
+
+	// CompactToken keeps no color, colors is the side table of ScannResult (empty for all white)
+	inline void Highlight(const InputSource& source, const std::vector<CompactToken>& token_set,
+		const std::vector<ConsoleForegroundColor>& colors,
+		const std::vector<std::pair<size_t, std::string>>& error_info_pair, std::ostream& log = std::cout)
+	{
+		std::vector<DebugViewToken> debug_tokens(token_set.size());
+		for (size_t i = 0; i < token_set.size(); ++i)
+		{
+			auto& token = token_set[i];
+			auto& debug_token = debug_tokens[i];
+			if (token.IsEndToken()) break;
+			debug_token.name = token.Text(source);
+			debug_token.line = token.Line(source);
+			debug_token.start = token.Column(source);
+			debug_token.end = debug_token.start + token.length - 1;
+			if (i < colors.size()) debug_token.color = colors[i];
+		}
+		Highlight(source, debug_tokens, error_info_pair, log);
+	}
+
+	inline void Highlight(const ScannResult<CompactToken>& result,
+		const std::vector<std::pair<size_t, std::string>>& error_info_pair, std::ostream& log = std::cout)
+	{
+		Highlight(*result.source, result.tokens, result.colors, error_info_pair, log);
+	}
+
+	inline void Highlight(const ScannResult<CompactToken>& result, std::ostream& log = std::cout)
+	{
+		Highlight(result, {}, log);
+	}
+}
\ No newline at end of file
@@ -1,23 +1,33 @@
 #pragma once
 #include <string>
 #include <iostream>
+#include <vector>
+#include <initializer_list>
 #include "Platform.h"
 #include "FileLoader.h"
 #include "EasyToken.h"
 #include "Scanner.h"
+#include "KeywordTable.h"
 
 namespace MuCplGen
 {
 	using namespace MuCplGen::Debug;
-	class EasyScanner : public Scanner<EasyToken>
+	template<class EasyTokenT = EasyToken>
+	class BasicEasyScanner : public Scanner<EasyTokenT>
 	{
-		using Token = EasyToken;
-		ScannRule* keyword;
+		using Token = EasyTokenT;
+		using Base = Scanner<EasyTokenT>;
+		using ScannRule = typename Base::ScannRule;
+		// identifiers found in keywords are keywords
+		KeywordTable keywords;
+		TokenTypeRegistry::Id keyword_type = TokenTypeRegistry::Register("keyword");
+		// only created by SetKeyword(std::regex)
+		ScannRule* keyword = nullptr;
 	public:
 		MU_NOINLINE
-		EasyScanner()
+		BasicEasyScanner()
 		{
-			auto& blank = CreateRule();
+			auto& blank = this->CreateRule();
 			blank.tokenType = "Blank";
 			blank.expression = CommonRegex::Blank;
 			blank.onSucceed = [this](std::smatch&, Token&)->ScannActionResult
@@ -25,7 +35,7 @@ namespace MuCplGen
 				return DiscardThisToken;
 			};
 
-			auto& comment = CreateRule();
+			auto& comment = this->CreateRule();
 			comment.tokenType = "Comment";
 			comment.expression = "^//.*";
 			comment.onSucceed = [this](std::smatch&, Token&)->ScannActionResult
@@ -33,7 +43,7 @@ namespace MuCplGen
 				return (ScannActionResult)(DiscardThisToken | SkipCurrentLine);
 			};
 
-			auto& num = CreateRule();
+			auto& num = this->CreateRule();
 			num.tokenType = "number";
 			num.expression = R"(^\d+(\.\d+)?)";
 			num.onSucceed = [this](std::smatch&, Token& token)->ScannActionResult
@@ -43,18 +53,27 @@ namespace MuCplGen
 				return SaveToken;
 			};
 
-			auto& id = CreateRule();
+			auto& id = this->CreateRule();
 			id.priority = 1;
 			id.tokenType = "identifier";
 			id.expression = CommonRegex::Identifier;
 			id.onSucceed = [this](std::smatch&, Token& token)->ScannActionResult
 			{
-				token.type = Token::TokenType::identifier;
-				token.color = ConsoleForegroundColor::White;
+				if (keywords.Contains(token.name))
+				{
+					token.TypeId(keyword_type);
+					token.type = Token::TokenType::keyword;
+					token.color = ConsoleForegroundColor::Blue;
+				}
+				else
+				{
+					token.type = Token::TokenType::identifier;
+					token.color = ConsoleForegroundColor::White;
+				}
 				return SaveToken;
 			};
 
-			auto& arith_operator = CreateRule();
+			auto& arith_operator = this->CreateRule();
 			arith_operator.tokenType = "arith_op";
 			arith_operator.expression = R"(^(\+|\-|\*|/|\^))";
 			arith_operator.onSucceed = [this](std::smatch&, Token& token)->ScannActionResult
@@ -64,7 +83,7 @@ namespace MuCplGen
 				return SaveToken;
 			};
 
-			auto& assign = CreateRule();
+			auto& assign = this->CreateRule();
 			assign.tokenType = "assign";
 			assign.expression = "^=";
 			assign.onSucceed = [this](std::smatch&, Token& token)->ScannActionResult
@@ -74,7 +93,7 @@ namespace MuCplGen
 				return SaveToken;
 			};
 
-			auto& sep = CreateRule();
+			auto& sep = this->CreateRule();
 			sep.tokenType = "separator";
 			sep.expression = R"(^(\.|\->|::|\{|\}|\(|\)|\[|\]|\,|;|:))";
 			sep.onSucceed = [this](std::smatch&, Token& token)->ScannActionResult
@@ -85,7 +104,7 @@ namespace MuCplGen
 			};
 
 
-			auto& rel_op = CreateRule();
+			auto& rel_op = this->CreateRule();
 			rel_op.tokenType = "rel_op";
 			rel_op.expression = "^(<|>|==|!=|<=|>=)";
 			rel_op.onSucceed = [this](std::smatch&, Token& token)->ScannActionResult
@@ -95,20 +114,10 @@ namespace MuCplGen
 				return SaveToken;
 			};
 
-			auto& keyword = CreateRule();
-			this->keyword = &keyword;
-			keyword.tokenType = "keyword";
-			keyword.expression = 
-				"^(void|char|float|int|return|enum|struct|class|private|switch"
-				"|case|break|default|if|else|while|do)";
-			keyword.onSucceed = [this](std::smatch&, Token& token)->ScannActionResult
-			{
-				token.type = Token::TokenType::keyword;
-				token.color = ConsoleForegroundColor::Blue;
-				return SaveToken;
-			};
+			SetKeyword({ "void", "char", "float", "int", "return", "enum", "struct", "class", "private", "switch",
+				"case", "break", "default", "if", "else", "while", "do" });
 
-			auto& raw_string = CreateRule();
+			auto& raw_string = this->CreateRule();
 			raw_string.tokenType = "raw_string";
 			raw_string.expression = CommonRegex::RawString;
 			raw_string.onSucceed = [this](std::smatch&, Token& token)->ScannActionResult
@@ -118,7 +127,7 @@ namespace MuCplGen
 				return SaveToken;
 			};
 
-			auto& logic_op = CreateRule();
+			auto& logic_op = this->CreateRule();
 			logic_op.tokenType = "log_op";
 			//<< >> ! && || & | 
 			logic_op.expression = "^(<<|>>|!|&&|\\|\\||&|\\|)";
@@ -130,10 +139,32 @@ namespace MuCplGen
 			};
 		}
 
-		void SetKeyword(const std::regex& r) { keyword->expression = r; }
-	};
-}
-
+		// whole identifiers only, "integer" is not the keyword "int"
+		void SetKeyword(const std::vector<std::string>& words) { keywords.Build(words); }
 
+		void SetKeyword(std::initializer_list<std::string> words) { SetKeyword(std::vector<std::string>(words)); }
 
+		// a regex rule instead of the keyword table, it only works with ScannEngine::Regex
+		MU_NOINLINE
+		void SetKeyword(const std::regex& r)
+		{
+			keywords.Build({});
+			if (!keyword)
+			{
+				keyword = &this->CreateRule();
+				keyword->tokenType = "keyword";
+				keyword->onSucceed = [this](std::smatch&, Token& token)->ScannActionResult
+				{
+					token.type = Token::TokenType::keyword;
+					token.color = ConsoleForegroundColor::Blue;
+					return SaveToken;
+				};
+			}
+			keyword->expression = r;
+		}
+	};
 
+	using EasyScanner = BasicEasyScanner<EasyToken>;
+	// use with ScannSource, token names refer into the scanned source
+	using EasyViewScanner = BasicEasyScanner<EasyViewToken>;
+}
\ No newline at end of file
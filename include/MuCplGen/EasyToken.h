@@ -4,27 +4,34 @@
 
 namespace MuCplGen
 {
-	struct EasyToken : public Debug::DebugToken
+	enum class EasyTokenType
 	{
-		enum class TokenType
-		{
-			none,
-			rel_op,
-			arith_op,
-			log_op,
-			number,
-			identifier,
-			assign,
-			keyword,
-			separator,
-			raw_string,
-			custom_type
-		};
+		none,
+		rel_op,
+		arith_op,
+		log_op,
+		number,
+		identifier,
+		assign,
+		keyword,
+		separator,
+		raw_string,
+		custom_type
+	};
+
+	template<class Base>
+	struct BasicEasyToken : public Debug::BasicDebugToken<Base>
+	{
+		using TokenType = EasyTokenType;
 		TokenType type = TokenType::none;
-		friend std::ostream& operator << (std::ostream& os, const EasyToken& token)
+		friend std::ostream& operator << (std::ostream& os, const BasicEasyToken& token)
 		{
-			os << dynamic_cast<const BaseToken&>(token) << std::endl;
+			os << static_cast<const Base&>(token) << std::endl;
 			return os;
 		}
 	};
+
+	using EasyToken = BasicEasyToken<BaseToken>;
+	// name refers into the source of ScannResult, no copy of the lexeme
+	using EasyViewToken = BasicEasyToken<ViewToken>;
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <fstream>
 #include <sstream>
 #include "LineContent.h"
+#include "InputSource.h"
 #include "Platform.h"
 
 namespace MuCplGen
@@ -23,6 +24,12 @@ namespace MuCplGen
 			return lineContent;
 		}
 
+		// map the file instead of reading it line by line, scann it with Scanner::ScannSource
+		static std::shared_ptr<const InputSource> Map(const std::string& path)
+		{
+			return InputSource::MapFile(path);
+		}
+
 		MU_NOINLINE
 		static std::vector<std::vector<LineContent>> Load(const std::string& path, std::string separator)
 		{
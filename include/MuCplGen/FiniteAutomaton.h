@@ -0,0 +1,641 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <bitset>
+#include <map>
+#include <algorithm>
+#include <cstdint>
+#include <cctype>
+#include "Platform.h"
+#include "MuException.h"
+
+namespace MuCplGen
+{
+	// Byte level DFA compiled from a list of scanner rules.
+	// All rules are merged into one automaton, so a token is recognized by a single pass over the bytes.
+	//
+	// Supported regex (ECMAScript subset):
+	//	literal, '.', [class], [^class], \d \D \w \W \s \S, \n \t \r \f \v \0 \xHH \uHHHH,
+	//	(group), (?:group), a|b, * + ? {n} {n,} {n,m} and the lazy forms *? +? ?? {n,m}?
+	//	'^' before anything is consumed
+	// Every rule is anchored at the current position, a rule is matched as long as it can
+	// (leftmost-longest), except rules using a lazy quantifier, which stop at their first match.
+	class FiniteAutomaton
+	{
+	public:
+		using CharSet = std::bitset<256>;
+		static constexpr size_t npos = (size_t)-1;
+
+		struct Rule
+		{
+			std::string pattern;
+			int priority = 0;
+		};
+
+		MU_NOINLINE
+		void Build(const std::vector<Rule>& rules)
+		{
+			nodes.clear();
+			nfa.clear();
+			sets.clear();
+			this->rules = rules;
+			lazy.assign(rules.size(), false);
+			auto nfa_start = NewState(npos);
+			for (size_t r = 0; r < rules.size(); ++r)
+			{
+				current_rule = r;
+				pattern = &rules[r].pattern;
+				pos = 0;
+				auto root = ParseAlternation(true);
+				if (pos != pattern->size()) Error("unmatched ')'");
+				auto frag = Compile(root);
+				nfa[nfa_start].eps.push_back(frag.first);
+				nfa[frag.second].accept = true;
+			}
+			SplitByteClasses();
+			Determinize(nfa_start);
+			Minimize();
+			nodes.clear();
+			nfa.clear();
+			sets.clear();
+		}
+
+		// match from begin, return index of the recognized rule (npos if none)
+		// length receives the length of the longest match
+		size_t Match(const char* begin, const char* end, size_t& length) const
+		{
+			size_t rule = npos;
+			length = 0;
+			uint32_t state = start;
+			for (auto p = begin; p != end; ++p)
+			{
+				state = next[state * class_count + byte_class[(unsigned char)*p]];
+				if (state == dead) break;
+				if (accept[state] >= 0)
+				{
+					rule = accept[state];
+					length = p - begin + 1;
+				}
+			}
+			return rule;
+		}
+
+		size_t StateCount() const { return accept.size(); }
+		size_t ClassCount() const { return class_count; }
+
+	private:
+		static constexpr uint32_t dead = 0;
+		static constexpr size_t max_repeat = 1000;
+
+		// regex syntax tree
+		struct Node
+		{
+			enum class Kind { Set, Concat, Alternation, Repeat, Empty } kind = Kind::Empty;
+			CharSet set;
+			std::vector<size_t> children;
+			size_t min = 0;
+			size_t max = 0;
+		};
+
+		struct NFAState
+		{
+			size_t rule = npos;
+			bool accept = false;
+			std::vector<size_t> eps;
+			// (index in sets, target)
+			std::vector<std::pair<size_t, size_t>> edges;
+		};
+
+		std::vector<Rule> rules;
+		std::vector<bool> lazy;
+		std::vector<Node> nodes;
+		std::vector<NFAState> nfa;
+		std::vector<CharSet> sets;
+		const std::string* pattern = nullptr;
+		size_t pos = 0;
+		size_t current_rule = 0;
+
+		// runtime tables
+		uint8_t byte_class[256] = {};
+		size_t class_count = 1;
+		uint32_t start = 0;
+		std::vector<uint32_t> next;
+		std::vector<int32_t> accept;
+
+		[[noreturn]] void Error(const std::string& what) const
+		{
+			throw(Exception("Scanner DFA: " + what + " in rule <" + *pattern + "> at " + std::to_string(pos)));
+		}
+
+		bool End() const { return pos >= pattern->size(); }
+		char Peek() const { return (*pattern)[pos]; }
+
+		size_t NewNode(Node::Kind kind)
+		{
+			nodes.push_back(Node());
+			nodes.back().kind = kind;
+			return nodes.size() - 1;
+		}
+
+		size_t NewSet(const CharSet& set)
+		{
+			auto n = NewNode(Node::Kind::Set);
+			nodes[n].set = set;
+			return n;
+		}
+
+		static CharSet Range(unsigned char a, unsigned char b)
+		{
+			CharSet s;
+			for (size_t c = a; c <= b; ++c) s.set(c);
+			return s;
+		}
+
+		static CharSet Digit() { return Range('0', '9'); }
+		static CharSet Word() { return Range('a', 'z') | Range('A', 'Z') | Range('0', '9') | Range('_', '_'); }
+		static CharSet Space()
+		{
+			CharSet s;
+			for (auto c : { ' ', '\t', '\n', '\v', '\f', '\r' }) s.set((unsigned char)c);
+			return s;
+		}
+
+		size_t ParseAlternation(bool at_start)
+		{
+			auto first = ParseConcat(at_start);
+			if (End() || Peek() != '|') return first;
+			auto alter = NewNode(Node::Kind::Alternation);
+			nodes[alter].children.push_back(first);
+			while (!End() && Peek() == '|')
+			{
+				++pos;
+				auto branch = ParseConcat(at_start);
+				nodes[alter].children.push_back(branch);
+			}
+			return alter;
+		}
+
+		size_t ParseConcat(bool at_start)
+		{
+			auto concat = NewNode(Node::Kind::Concat);
+			while (!End() && Peek() != '|' && Peek() != ')')
+			{
+				if (Peek() == '^')
+				{
+					if (!at_start) Error("'^' is only supported at the beginning");
+					++pos;
+					continue;
+				}
+				auto atom = ParseAtom(at_start);
+				atom = ParseQuantifier(atom);
+				nodes[concat].children.push_back(atom);
+				at_start = false;
+			}
+			return concat;
+		}
+
+		size_t ParseNumber()
+		{
+			if (End() || !isdigit((unsigned char)Peek())) Error("number expected");
+			size_t n = 0;
+			while (!End() && isdigit((unsigned char)Peek()))
+			{
+				n = n * 10 + (Peek() - '0');
+				if (n > max_repeat) Error("repeat count is too large");
+				++pos;
+			}
+			return n;
+		}
+
+		size_t ParseQuantifier(size_t atom)
+		{
+			while (!End())
+			{
+				size_t min = 0, max = npos;
+				auto c = Peek();
+				if (c == '*') { min = 0; max = npos; ++pos; }
+				else if (c == '+') { min = 1; max = npos; ++pos; }
+				else if (c == '?') { min = 0; max = 1; ++pos; }
+				else if (c == '{')
+				{
+					++pos;
+					min = ParseNumber();
+					max = min;
+					if (!End() && Peek() == ',')
+					{
+						++pos;
+						if (!End() && Peek() == '}') max = npos;
+						else max = ParseNumber();
+					}
+					if (End() || Peek() != '}') Error("'}' expected");
+					if (max < min) Error("bad repeat range");
+					++pos;
+				}
+				else break;
+				if (!End() && Peek() == '?')
+				{
+					lazy[current_rule] = true;
+					++pos;
+				}
+				auto repeat = NewNode(Node::Kind::Repeat);
+				nodes[repeat].children.push_back(atom);
+				nodes[repeat].min = min;
+				nodes[repeat].max = max;
+				atom = repeat;
+			}
+			return atom;
+		}
+
+		unsigned char ParseHex(size_t digits)
+		{
+			size_t v = 0;
+			for (size_t i = 0; i < digits; ++i, ++pos)
+			{
+				if (End() || !isxdigit((unsigned char)Peek())) Error("hex digit expected");
+				auto c = (char)tolower(Peek());
+				v = v * 16 + (isdigit((unsigned char)c) ? c - '0' : c - 'a' + 10);
+			}
+			if (v > 255) Error("only single byte characters are supported");
+			return (unsigned char)v;
+		}
+
+		// pos is right after '\'
+		CharSet ParseEscape(bool in_class)
+		{
+			if (End()) Error("trailing '\\'");
+			auto c = Peek();
+			++pos;
+			switch (c)
+			{
+			case 'd': return Digit();
+			case 'D': return ~Digit();
+			case 'w': return Word();
+			case 'W': return ~Word();
+			case 's': return Space();
+			case 'S': return ~Space();
+			case 'n': return Range('\n', '\n');
+			case 't': return Range('\t', '\t');
+			case 'r': return Range('\r', '\r');
+			case 'f': return Range('\f', '\f');
+			case 'v': return Range('\v', '\v');
+			case 'x': { auto v = ParseHex(2); return Range(v, v); }
+			case 'u': { auto v = ParseHex(4); return Range(v, v); }
+			case '0':
+				if (!End() && isdigit((unsigned char)Peek())) Error("octal escape is not supported");
+				return Range(0, 0);
+			case 'b':
+				if (in_class) return Range('\b', '\b');
+				Error("word boundary is not supported");
+			case 'B': Error("word boundary is not supported");
+			case 'c': Error("control escape is not supported");
+			default:
+				if (isdigit((unsigned char)c)) Error("back reference is not supported");
+				return Range((unsigned char)c, (unsigned char)c);
+			}
+		}
+
+		size_t ParseClass()
+		{
+			// pos is right after '['
+			bool negate = false;
+			if (!End() && Peek() == '^')
+			{
+				negate = true;
+				++pos;
+			}
+			CharSet set;
+			while (true)
+			{
+				if (End()) Error("']' expected");
+				if (Peek() == ']')
+				{
+					++pos;
+					break;
+				}
+				CharSet low;
+				bool single = true;
+				unsigned char low_char = 0;
+				if (Peek() == '\\')
+				{
+					++pos;
+					low = ParseEscape(true);
+					single = low.count() == 1;
+					if (single) for (size_t c = 0; c < 256; ++c) if (low[c]) low_char = (unsigned char)c;
+				}
+				else
+				{
+					low_char = (unsigned char)Peek();
+					low.set(low_char);
+					++pos;
+				}
+				if (single && pos + 1 < pattern->size() && Peek() == '-' && (*pattern)[pos + 1] != ']')
+				{
+					++pos;
+					unsigned char high_char;
+					if (Peek() == '\\')
+					{
+						++pos;
+						auto high = ParseEscape(true);
+						if (high.count() != 1) Error("bad class range");
+						high_char = 0;
+						for (size_t c = 0; c < 256; ++c) if (high[c]) high_char = (unsigned char)c;
+					}
+					else high_char = (unsigned char)(*pattern)[pos++];
+					if (high_char < low_char) Error("bad class range");
+					set |= Range(low_char, high_char);
+				}
+				else set |= low;
+			}
+			return NewSet(negate ? ~set : set);
+		}
+
+		size_t ParseAtom(bool at_start)
+		{
+			auto c = Peek();
+			switch (c)
+			{
+			case '(':
+			{
+				++pos;
+				if (!End() && Peek() == '?')
+				{
+					if (pos + 1 < pattern->size() && (*pattern)[pos + 1] == ':') pos += 2;
+					else Error("lookahead is not supported");
+				}
+				auto inner = ParseAlternation(at_start);
+				if (End() || Peek() != ')') Error("')' expected");
+				++pos;
+				return inner;
+			}
+			case '[':
+				++pos;
+				return ParseClass();
+			case '.':
+			{
+				++pos;
+				CharSet s;
+				s.set();
+				s.reset('\n');
+				s.reset('\r');
+				return NewSet(s);
+			}
+			case '\\':
+				++pos;
+				return NewSet(ParseEscape(false));
+			case '$': Error("'$' is not supported");
+			case '*': case '+': case '?': case '{': Error("nothing to repeat");
+			default:
+				++pos;
+				return NewSet(Range((unsigned char)c, (unsigned char)c));
+			}
+		}
+
+		size_t NewState(size_t rule)
+		{
+			nfa.push_back(NFAState());
+			nfa.back().rule = rule;
+			return nfa.size() - 1;
+		}
+
+		// Thompson construction, return (entry, exit)
+		std::pair<size_t, size_t> Compile(size_t n)
+		{
+			auto in = NewState(current_rule);
+			auto out = NewState(current_rule);
+			const auto kind = nodes[n].kind;
+			switch (kind)
+			{
+			case Node::Kind::Empty:
+				nfa[in].eps.push_back(out);
+				break;
+			case Node::Kind::Set:
+				sets.push_back(nodes[n].set);
+				nfa[in].edges.push_back({ sets.size() - 1, out });
+				break;
+			case Node::Kind::Concat:
+			{
+				auto last = in;
+				for (size_t i = 0; i < nodes[n].children.size(); ++i)
+				{
+					auto frag = Compile(nodes[n].children[i]);
+					nfa[last].eps.push_back(frag.first);
+					last = frag.second;
+				}
+				nfa[last].eps.push_back(out);
+				break;
+			}
+			case Node::Kind::Alternation:
+				for (size_t i = 0; i < nodes[n].children.size(); ++i)
+				{
+					auto frag = Compile(nodes[n].children[i]);
+					nfa[in].eps.push_back(frag.first);
+					nfa[frag.second].eps.push_back(out);
+				}
+				break;
+			case Node::Kind::Repeat:
+			{
+				auto child = nodes[n].children[0];
+				auto min = nodes[n].min;
+				auto max = nodes[n].max;
+				auto last = in;
+				for (size_t i = 0; i < min; ++i)
+				{
+					auto frag = Compile(child);
+					nfa[last].eps.push_back(frag.first);
+					last = frag.second;
+				}
+				if (max == npos)
+				{
+					auto frag = Compile(child);
+					nfa[last].eps.push_back(frag.first);
+					nfa[last].eps.push_back(out);
+					nfa[frag.second].eps.push_back(frag.first);
+					nfa[frag.second].eps.push_back(out);
+				}
+				else
+				{
+					for (size_t i = min; i < max; ++i)
+					{
+						auto frag = Compile(child);
+						nfa[last].eps.push_back(frag.first);
+						nfa[last].eps.push_back(out);
+						last = frag.second;
+					}
+					nfa[last].eps.push_back(out);
+				}
+				break;
+			}
+			}
+			return { in, out };
+		}
+
+		// bytes that no rule can tell apart share one column of the transition table
+		void SplitByteClasses()
+		{
+			std::vector<size_t> cls(256, 0);
+			size_t count = 1;
+			for (const auto& set : sets)
+			{
+				std::map<std::pair<size_t, bool>, size_t> remap;
+				size_t new_count = 0;
+				for (size_t c = 0; c < 256; ++c)
+				{
+					auto key = std::make_pair(cls[c], (bool)set[c]);
+					auto iter = remap.find(key);
+					if (iter == remap.end()) iter = remap.insert({ key, new_count++ }).first;
+					cls[c] = iter->second;
+				}
+				count = new_count;
+			}
+			class_count = count;
+			for (size_t c = 0; c < 256; ++c) byte_class[c] = (uint8_t)cls[c];
+		}
+
+		void Closure(std::vector<size_t>& states) const
+		{
+			std::vector<bool> in(nfa.size(), false);
+			for (auto s : states) in[s] = true;
+			std::vector<size_t> stack = states;
+			while (!stack.empty())
+			{
+				auto s = stack.back();
+				stack.pop_back();
+				for (auto t : nfa[s].eps)
+					if (!in[t])
+					{
+						in[t] = true;
+						states.push_back(t);
+						stack.push_back(t);
+					}
+			}
+			// a lazy rule stops at its first match: drop the rest of its threads
+			for (size_t r = 0; r < lazy.size(); ++r)
+			{
+				if (!lazy[r]) continue;
+				auto accepted = std::any_of(states.begin(), states.end(),
+					[&](size_t s) { return nfa[s].rule == r && nfa[s].accept; });
+				if (accepted)
+					states.erase(std::remove_if(states.begin(), states.end(),
+						[&](size_t s) { return nfa[s].rule == r && !nfa[s].accept; }), states.end());
+			}
+			std::sort(states.begin(), states.end());
+		}
+
+		// the winner among rules accepted by the same length:
+		// the smaller priority, then the later rule (same as the regex engine)
+		int32_t Winner(const std::vector<size_t>& states) const
+		{
+			int32_t best = -1;
+			for (auto s : states)
+			{
+				if (!nfa[s].accept) continue;
+				auto r = (int32_t)nfa[s].rule;
+				if (best < 0
+					|| rules[r].priority < rules[best].priority
+					|| (rules[r].priority == rules[best].priority && r > best))
+					best = r;
+			}
+			return best;
+		}
+
+		void Determinize(size_t nfa_start)
+		{
+			std::vector<unsigned char> representative(class_count);
+			for (int c = 255; c >= 0; --c) representative[byte_class[c]] = (unsigned char)c;
+
+			std::map<std::vector<size_t>, uint32_t> index;
+			std::vector<std::vector<size_t>> dstates;
+			// state 0 is the dead state
+			dstates.push_back({});
+			index[{}] = dead;
+			accept.assign(1, -1);
+
+			std::vector<size_t> first = { nfa_start };
+			Closure(first);
+			index[first] = 1;
+			dstates.push_back(first);
+			accept.push_back(Winner(first));
+			start = 1;
+
+			next.assign(2 * class_count, dead);
+			for (size_t d = 1; d < dstates.size(); ++d)
+				for (size_t c = 0; c < class_count; ++c)
+				{
+					auto byte = representative[c];
+					std::vector<size_t> target;
+					std::vector<bool> in(nfa.size(), false);
+					for (auto s : dstates[d])
+						for (const auto& [set, t] : nfa[s].edges)
+							if (sets[set][byte] && !in[t])
+							{
+								in[t] = true;
+								target.push_back(t);
+							}
+					if (target.empty()) continue;
+					Closure(target);
+					auto iter = index.find(target);
+					uint32_t id;
+					if (iter == index.end())
+					{
+						id = (uint32_t)dstates.size();
+						index.insert({ target, id });
+						accept.push_back(Winner(target));
+						dstates.push_back(std::move(target));
+						next.resize(dstates.size() * class_count, dead);
+					}
+					else id = iter->second;
+					next[d * class_count + c] = id;
+				}
+		}
+
+		// Moore partition refinement
+		void Minimize()
+		{
+			auto count = accept.size();
+			std::vector<uint32_t> group(count);
+			{
+				std::map<int32_t, uint32_t> by_accept;
+				// keep the dead state in group 0
+				by_accept[accept[dead]] = 0;
+				for (size_t s = 0; s < count; ++s)
+				{
+					auto iter = by_accept.find(accept[s]);
+					if (iter == by_accept.end()) iter = by_accept.insert({ accept[s], (uint32_t)by_accept.size() }).first;
+					group[s] = iter->second;
+				}
+			}
+			size_t group_count = 0;
+			while (true)
+			{
+				std::map<std::vector<uint32_t>, uint32_t> signatures;
+				std::vector<uint32_t> new_group(count);
+				std::vector<uint32_t> sig(class_count + 1);
+				// dead state first, so that it keeps id 0
+				for (size_t k = 0; k < count; ++k)
+				{
+					auto s = k;
+					sig[0] = group[s];
+					for (size_t c = 0; c < class_count; ++c) sig[c + 1] = group[next[s * class_count + c]];
+					auto iter = signatures.find(sig);
+					if (iter == signatures.end()) iter = signatures.insert({ sig, (uint32_t)signatures.size() }).first;
+					new_group[s] = iter->second;
+				}
+				group.swap(new_group);
+				if (signatures.size() == group_count) break;
+				group_count = signatures.size();
+			}
+
+			std::vector<uint32_t> min_next(group_count * class_count, dead);
+			std::vector<int32_t> min_accept(group_count, -1);
+			for (size_t s = 0; s < count; ++s)
+			{
+				min_accept[group[s]] = accept[s];
+				for (size_t c = 0; c < class_count; ++c)
+					min_next[group[s] * class_count + c] = group[next[s * class_count + c]];
+			}
+			start = group[start];
+			next.swap(min_next);
+			accept.swap(min_accept);
+		}
+	};
+}
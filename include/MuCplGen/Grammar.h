@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "Span.h"
+
+namespace MuCplGen
+{
+	// productions in flat arrays, a production is known by its id:
+	// the body of production p is symbols[production_begin[p], production_begin[p + 1]), its head is heads[p],
+	// the productions of nonterm A are the ids [nonterm_begin[A], nonterm_begin[A + 1])
+	template<typename T>
+	class Grammar
+	{
+	public:
+		std::vector<T> symbols;
+		std::vector<size_t> production_begin = { 0 };
+		std::vector<T> heads;
+		std::vector<size_t> nonterm_begin = { 0 };
+
+		Grammar() = default;
+
+		// production_table[A][production_index] is a body of A
+		explicit Grammar(const std::vector<std::vector<std::vector<T>>>& production_table)
+		{
+			for (size_t A = 0; A < production_table.size(); ++A)
+			{
+				for (const auto& production : production_table[A])
+				{
+					symbols.insert(symbols.end(), production.begin(), production.end());
+					production_begin.push_back(symbols.size());
+					heads.push_back((T)A);
+				}
+				nonterm_begin.push_back(heads.size());
+			}
+		}
+
+		size_t NontermCount() const { return nonterm_begin.size() - 1; }
+		size_t ProductionCount() const { return heads.size(); }
+		size_t ProductionCountOf(T A) const { return nonterm_begin[(size_t)A + 1] - nonterm_begin[A]; }
+
+		// id of the production production_index of A
+		size_t ProductionOf(T A, size_t production_index) const { return nonterm_begin[A] + production_index; }
+		// production_index of p among the productions of its head
+		size_t IndexOf(size_t p) const { return p - nonterm_begin[heads[p]]; }
+
+		Span<const T> Body(size_t p) const
+		{
+			return { symbols.data() + production_begin[p], production_begin[p + 1] - production_begin[p] };
+		}
+		Span<const T> Body(T A, size_t production_index) const { return Body(ProductionOf(A, production_index)); }
+
+		// stored with the parse table, a table of another grammar is not loaded
+		size_t Hash() const
+		{
+			size_t h = 14695981039346656037ull;
+			auto mix = [&h](size_t value) { h = (h ^ value) * 1099511628211ull; };
+			for (auto begin : nonterm_begin) mix(begin);
+			for (auto begin : production_begin) mix(begin);
+			for (auto sym : symbols) mix((size_t)sym);
+			return h;
+		}
+	};
+}
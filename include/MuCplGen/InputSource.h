@@ -0,0 +1,170 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstring>
+#include <algorithm>
+#include "Platform.h"
+#include "MuException.h"
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace MuCplGen
+{
+	// the text to scann, as one contiguous buffer instead of a string per line:
+	// - MapFile: the file is memory mapped, nothing is copied
+	// - Borrow: a buffer owned by the caller, which must outlive the source
+	// - Own: a string moved into the source
+	// line starts are indexed lazily on the first line query
+	class InputSource
+	{
+	public:
+		MU_NOINLINE
+		static std::shared_ptr<const InputSource> MapFile(const std::string& path, size_t first_line_no = 1)
+		{
+			std::shared_ptr<InputSource> source(new InputSource(first_line_no));
+#ifdef _WIN32
+			auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+				OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE) throw(Exception("Can't open file: " + path));
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(file, &size)) { CloseHandle(file); throw(Exception("Can't read file size: " + path)); }
+			if (size.QuadPart > 0)
+			{
+				auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				if (!mapping) { CloseHandle(file); throw(Exception("Can't map file: " + path)); }
+				auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				CloseHandle(mapping);
+				if (!view) { CloseHandle(file); throw(Exception("Can't map file: " + path)); }
+				source->data = static_cast<const char*>(view);
+				source->size = (size_t)size.QuadPart;
+				source->mapped = true;
+			}
+			CloseHandle(file);
+#else
+			auto fd = open(path.c_str(), O_RDONLY);
+			if (fd < 0) throw(Exception("Can't open file: " + path));
+			struct stat info;
+			if (fstat(fd, &info) != 0) { close(fd); throw(Exception("Can't read file size: " + path)); }
+			if (info.st_size > 0)
+			{
+				auto view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (view == MAP_FAILED) { close(fd); throw(Exception("Can't map file: " + path)); }
+				madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);
+				source->data = static_cast<const char*>(view);
+				source->size = (size_t)info.st_size;
+				source->mapped = true;
+			}
+			close(fd);
+#endif
+			return source;
+		}
+
+		static std::shared_ptr<const InputSource> Borrow(const char* data, size_t size, size_t first_line_no = 1)
+		{
+			std::shared_ptr<InputSource> source(new InputSource(first_line_no));
+			source->data = data;
+			source->size = size;
+			return source;
+		}
+
+		static std::shared_ptr<const InputSource> Borrow(std::string_view text, size_t first_line_no = 1)
+		{
+			return Borrow(text.data(), text.size(), first_line_no);
+		}
+
+		static std::shared_ptr<const InputSource> Own(std::string text, size_t first_line_no = 1)
+		{
+			std::shared_ptr<InputSource> source(new InputSource(first_line_no));
+			source->storage = std::move(text);
+			source->data = source->storage.data();
+			source->size = source->storage.size();
+			return source;
+		}
+
+		InputSource(const InputSource&) = delete;
+		InputSource& operator=(const InputSource&) = delete;
+
+		~InputSource()
+		{
+			if (!mapped) return;
+#ifdef _WIN32
+			UnmapViewOfFile(data);
+#else
+			munmap(const_cast<char*>(data), size);
+#endif
+		}
+
+		const char* Data() const { return data; }
+		size_t Size() const { return size; }
+		std::string_view Text() const { return std::string_view(data, size); }
+		size_t FirstLineNo() const { return first_line_no; }
+
+		// lines are split like std::getline: a trailing '\n' doesn't start a new line
+		size_t LineCount() const { return LineStarts().size(); }
+
+		// offset of the first char of line i (0-based)
+		size_t LineBegin(size_t i) const { return LineStarts()[i]; }
+
+		// offset one past the last char of line i, the '\n' excluded, also the trailing one of the last line
+		size_t LineEnd(size_t i) const
+		{
+			auto& starts = LineStarts();
+			if (i + 1 < starts.size()) return starts[i + 1] - 1;
+			return data[size - 1] == '\n' ? size - 1 : size;
+		}
+
+		std::string_view Line(size_t i) const
+		{
+			auto begin = LineBegin(i);
+			return std::string_view(data + begin, LineEnd(i) - begin);
+		}
+
+		// 0-based line containing offset
+		size_t LineOf(size_t offset) const
+		{
+			auto& starts = LineStarts();
+			return std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin() - 1;
+		}
+
+	private:
+		InputSource(size_t first_line_no) : first_line_no(first_line_no) {}
+
+		const std::vector<size_t>& LineStarts() const
+		{
+			std::call_once(index_flag, [this]() { BuildLineIndex(); });
+			return line_starts;
+		}
+
+		MU_NOINLINE
+		void BuildLineIndex() const
+		{
+			if (!size) return;
+			line_starts.push_back(0);
+			auto end = data + size;
+			auto iter = data;
+			while (auto next = static_cast<const char*>(std::memchr(iter, '\n', end - iter)))
+			{
+				iter = next + 1;
+				if (iter == end) break;
+				line_starts.push_back(iter - data);
+			}
+		}
+
+		const char* data = nullptr;
+		size_t size = 0;
+		size_t first_line_no = 1;
+		bool mapped = false;
+		std::string storage;
+		mutable std::once_flag index_flag;
+		mutable std::vector<size_t> line_starts;
+	};
+}
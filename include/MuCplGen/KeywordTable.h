@@ -0,0 +1,97 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "Platform.h"
+
+namespace MuCplGen
+{
+	// perfect hash set of words: every word owns a distinct slot,
+	// so a lookup is one hash and at most one string compare
+	class KeywordTable
+	{
+	public:
+		static constexpr size_t npos = (size_t)-1;
+
+		KeywordTable() = default;
+		KeywordTable(const std::vector<std::string>& words) { Build(words); }
+
+		// searches a seed without collision, the table grows if none is found
+		MU_NOINLINE
+		void Build(const std::vector<std::string>& words)
+		{
+			this->words = words;
+			std::sort(this->words.begin(), this->words.end());
+			this->words.erase(std::unique(this->words.begin(), this->words.end()), this->words.end());
+			min_length = (size_t)-1;
+			max_length = 0;
+			for (auto& word : this->words)
+			{
+				min_length = (std::min)(min_length, word.size());
+				max_length = (std::max)(max_length, word.size());
+			}
+			size_t size = 1;
+			while (size < this->words.size() * 2) size <<= 1;
+			while (true)
+			{
+				mask = size - 1;
+				for (seed = 1; seed <= max_seed; ++seed)
+					if (TryFill()) return;
+				size <<= 1;
+			}
+		}
+
+		// index into Words(), or npos
+		size_t Find(std::string_view word) const
+		{
+			if (word.size() < min_length || word.size() > max_length) return npos;
+			auto slot = slots[Slot(word)];
+			if (slot && words[slot - 1] == word) return slot - 1;
+			return npos;
+		}
+
+		bool Contains(std::string_view word) const { return Find(word) != npos; }
+
+		bool Empty() const { return words.empty(); }
+
+		const std::vector<std::string>& Words() const { return words; }
+
+	private:
+		static constexpr uint64_t max_seed = 1024;
+
+		size_t Slot(std::string_view word) const
+		{
+			// FNV-1a, seeded
+			uint64_t hash = 14695981039346656037ull ^ (seed * 0x9E3779B97F4A7C15ull);
+			for (auto c : word)
+			{
+				hash ^= (unsigned char)c;
+				hash *= 1099511628211ull;
+			}
+			hash ^= hash >> 29;
+			return (size_t)hash & mask;
+		}
+
+		bool TryFill()
+		{
+			slots.assign(mask + 1, 0);
+			for (size_t i = 0; i < words.size(); ++i)
+			{
+				auto& slot = slots[Slot(words[i])];
+				if (slot) return false;
+				slot = (uint32_t)i + 1;
+			}
+			return true;
+		}
+
+		std::vector<std::string> words;
+		// index of word + 1, 0 is empty
+		std::vector<uint32_t> slots = { 0 };
+		uint64_t seed = 1;
+		size_t mask = 0;
+		size_t min_length = (size_t)-1;
+		size_t max_length = 0;
+	};
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <string_view>
 
 namespace MuCplGen
 {
@@ -8,4 +9,11 @@ namespace MuCplGen
 		std::string content;
 		size_t line_no;
 	};
+
+	// a line of an InputSource, refers into the source
+	struct LineView
+	{
+		std::string_view content;
+		size_t line_no;
+	};
 }
@@ -5,5 +5,7 @@
 #include "CFG.h"// Context Free Grammar
 #include "EasyScanner.h"
 #include "FileLoader.h"
+#include "InputSource.h"
+#include "ThreadPool.h"
 #include "DebugTool/Highlight.h"
 
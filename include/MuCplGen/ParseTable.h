@@ -0,0 +1,595 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <tuple>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
+#include "Platform.h"
+#include "PushDownAutomaton.h"
+#include "MuException.h"
+#include "Span.h"
+
+namespace MuCplGen
+{
+	// one ACTION cell in 32 bits: ActionType + 1 in the top 3 bits (0 is error),
+	// below it the state to push for move_in/move_epsilon, or the production id for reduce/accept
+	class ActionWord
+	{
+	public:
+		static constexpr uint32_t value_bits = 29;
+		static constexpr uint32_t max_value = (1u << value_bits) - 1;
+
+		ActionWord() = default;
+
+		ActionWord(ActionType type, size_t value)
+		{
+			if (value > max_value)
+				throw(Exception("Parse table overflow: " + std::to_string(value) + " doesn't fit in an ActionWord"));
+			word = ((uint32_t)((int)type + 1) << value_bits) | (uint32_t)value;
+		}
+
+		bool Error() const { return word == 0; }
+		ActionType Type() const { return (ActionType)((int)(word >> value_bits) - 1); }
+		// state for move_in/move_epsilon, production id for reduce/accept
+		uint32_t Value() const { return word & max_value; }
+
+		bool operator==(ActionWord other) const { return word == other.word; }
+		bool operator!=(ActionWord other) const { return word != other.word; }
+		bool operator<(ActionWord other) const { return word < other.word; }
+
+	private:
+		uint32_t word = 0;
+	};
+	static_assert(sizeof(ActionWord) == sizeof(uint32_t), "ActionWord should be 32 bits");
+
+	// a production as the parser needs it, reduce/accept ActionWords hold its id
+	struct ProductionInfo
+	{
+		uint32_t head;
+		// index among the productions of head
+		uint32_t index;
+		uint32_t length;
+	};
+
+	// binary layout of stored tables: a header, then the fields of the table
+	// not cross-platform, like the rest of the stored build result
+	struct ParseTableFile
+	{
+		static constexpr uint32_t magic = 0x5450554D; // "MUPT"
+		static constexpr uint32_t version = 1;
+		enum Kind : uint32_t { Dense = 1, Compressed = 2 };
+
+		static void WriteHeader(std::ostream& o, Kind kind)
+		{
+			Write(o, magic);
+			Write(o, version);
+			Write(o, (uint32_t)kind);
+		}
+
+		static bool ReadHeader(std::istream& i, Kind kind)
+		{
+			uint32_t file_magic = 0, file_version = 0, file_kind = 0;
+			return Read(i, file_magic) && Read(i, file_version) && Read(i, file_kind)
+				&& file_magic == magic && file_version == version && file_kind == (uint32_t)kind;
+		}
+
+		template<class Ty>
+		static void Write(std::ostream& o, const Ty& value)
+		{
+			o.write((const char*)&value, sizeof(Ty));
+		}
+
+		template<class Ty>
+		static void Write(std::ostream& o, const std::vector<Ty>& values)
+		{
+			Write(o, (uint64_t)values.size());
+			o.write((const char*)values.data(), values.size() * sizeof(Ty));
+		}
+
+		template<class Ty>
+		static bool Read(std::istream& i, Ty& value)
+		{
+			return (bool)i.read((char*)&value, sizeof(Ty));
+		}
+
+		template<class Ty>
+		static bool Read(std::istream& i, std::vector<Ty>& values)
+		{
+			uint64_t size = 0;
+			if (!Read(i, size)) return false;
+			// a damaged size must not allocate the world
+			auto pos = i.tellg();
+			i.seekg(0, std::ios::end);
+			auto left = (uint64_t)(i.tellg() - pos);
+			i.seekg(pos);
+			if (size > left / sizeof(Ty)) return false;
+			values.resize((size_t)size);
+			return (bool)i.read((char*)values.data(), size * sizeof(Ty));
+		}
+	};
+
+	// the symbols with an action in each state, built with the table,
+	// so error reporting and completion read a list instead of scanning a row
+	class ExpectIndex
+	{
+	public:
+		// has_action(state, sym)
+		template<class F>
+		void Build(size_t state_count, size_t symbol_count, F&& has_action)
+		{
+			begins.assign(1, 0);
+			symbols.clear();
+			for (size_t state = 0; state < state_count; ++state)
+			{
+				for (size_t sym = 0; sym < symbol_count; ++sym)
+					if (has_action(state, sym)) symbols.push_back((uint32_t)sym);
+				begins.push_back((uint32_t)symbols.size());
+			}
+		}
+
+		Span<const uint32_t> Of(size_t state) const
+		{
+			if (state + 1 >= begins.size()) return {};
+			return Span<const uint32_t>(symbols.data() + begins[state], begins[state + 1] - begins[state]);
+		}
+
+		template<typename T>
+		std::vector<T> ToVector(size_t state) const
+		{
+			auto expected = Of(state);
+			return std::vector<T>(expected.begin(), expected.end());
+		}
+
+		size_t Size() const { return (begins.size() + symbols.size()) * sizeof(uint32_t); }
+
+	private:
+		// symbols of state i are symbols[begins[i], begins[i + 1])
+		std::vector<uint32_t> begins = { 0 };
+		std::vector<uint32_t> symbols;
+	};
+
+	// ACTION and GOTO as states x symbols arrays of packed words, built from the hash tables after SetActionTable,
+	// a parse step is one load
+	template<typename T>
+	class DenseParseTable
+	{
+	public:
+		using ActionTable = typename PushDownAutomaton<T>::ActionTable;
+		using GotoTable = typename PushDownAutomaton<T>::GotoTable;
+		static constexpr uint32_t no_state = (uint32_t)-1;
+
+		MU_NOINLINE
+		void Build(const ActionTable& action_table, const GotoTable& goto_table)
+		{
+			state_count = 0;
+			symbol_count = 0;
+			nonterm_count = 0;
+			epsilon = (uint32_t)-1;
+			// production ids in (head, index) order
+			std::map<std::pair<size_t, size_t>, size_t> production_lengths;
+			for (auto& [key, action] : action_table)
+			{
+				state_count = (std::max)(state_count, key.first + 1);
+				symbol_count = (std::max)(symbol_count, (size_t)key.second + 1);
+				switch (action.type)
+				{
+				case ActionType::move_epsilon:
+					epsilon = (uint32_t)action.sym;
+					[[fallthrough]];
+				case ActionType::move_in:
+					state_count = (std::max)(state_count, action.aim_state + 1);
+					break;
+				case ActionType::reduce:
+				case ActionType::accept:
+					nonterm_count = (std::max)(nonterm_count, (size_t)action.sym + 1);
+					production_lengths[{ (size_t)action.sym, action.production_index }] = action.production_length;
+					break;
+				default:
+					break;
+				}
+			}
+			for (auto& [key, state] : goto_table)
+				state_count = (std::max)(state_count, (std::max)(key.first, state) + 1);
+
+			productions.clear();
+			std::map<std::pair<size_t, size_t>, size_t> production_ids;
+			for (auto& [production, length] : production_lengths)
+			{
+				production_ids[production] = productions.size();
+				productions.push_back({ (uint32_t)production.first, (uint32_t)production.second, (uint32_t)length });
+			}
+
+			action_cells.assign(state_count * symbol_count, ActionWord());
+			for (auto& [key, action] : action_table)
+			{
+				auto& cell = action_cells[key.first * symbol_count + (size_t)key.second];
+				if (action.type == ActionType::reduce || action.type == ActionType::accept)
+					cell = ActionWord(action.type, production_ids[{ (size_t)action.sym, action.production_index }]);
+				else
+					cell = ActionWord(action.type, action.aim_state);
+			}
+
+			goto_cells.assign(state_count * nonterm_count, no_state);
+			for (auto& [key, state] : goto_table)
+				if ((size_t)key.second < nonterm_count)
+					goto_cells[key.first * nonterm_count + (size_t)key.second] = (uint32_t)state;
+			BuildExpects();
+		}
+
+		bool Empty() const { return action_cells.empty(); }
+
+		ActionWord Find(size_t state, T sym) const
+		{
+			if ((size_t)sym >= symbol_count) return ActionWord();
+			return action_cells[state * symbol_count + (size_t)sym];
+		}
+
+		size_t Goto(size_t state, T nonterm) const
+		{
+			auto next = (size_t)nonterm < nonterm_count ? goto_cells[state * nonterm_count + (size_t)nonterm] : no_state;
+			if (next == no_state)
+				throw(Exception("No GOTO for state " + std::to_string(state) + " and nonterm " + std::to_string((size_t)nonterm)));
+			return next;
+		}
+
+		const ProductionInfo& Production(size_t id) const { return productions[id]; }
+
+		size_t MaxProductionLength() const
+		{
+			size_t length = 0;
+			for (auto& production : productions) length = (std::max)(length, (size_t)production.length);
+			return length;
+		}
+
+		// the symbols with an action in state
+		Span<const uint32_t> Expected(size_t state) const { return expects.Of(state); }
+		std::vector<T> Expects(size_t state) const { return expects.ToVector<T>(state); }
+
+		// the symbol move_epsilon pushes
+		T Epsilon() const { return (T)epsilon; }
+
+		size_t StateCount() const { return state_count; }
+		size_t SymbolCount() const { return symbol_count; }
+
+		// bytes used by the arrays
+		size_t Size() const
+		{
+			return action_cells.size() * sizeof(ActionWord) + goto_cells.size() * sizeof(uint32_t)
+				+ productions.size() * sizeof(ProductionInfo) + expects.Size();
+		}
+
+		size_t DenseSize() const { return Size(); }
+
+		void Save(std::ostream& o) const
+		{
+			ParseTableFile::WriteHeader(o, ParseTableFile::Dense);
+			SaveFields(o);
+		}
+
+		bool Load(std::istream& i)
+		{
+			return ParseTableFile::ReadHeader(i, ParseTableFile::Dense) && LoadFields(i);
+		}
+
+	private:
+		template<typename Ty>
+		friend class CompressedParseTable;
+
+		void SaveFields(std::ostream& o) const
+		{
+			ParseTableFile::Write(o, (uint64_t)state_count);
+			ParseTableFile::Write(o, (uint64_t)symbol_count);
+			ParseTableFile::Write(o, (uint64_t)nonterm_count);
+			ParseTableFile::Write(o, epsilon);
+			ParseTableFile::Write(o, productions);
+			ParseTableFile::Write(o, action_cells);
+			ParseTableFile::Write(o, goto_cells);
+		}
+
+		bool LoadFields(std::istream& i)
+		{
+			uint64_t states = 0, symbols = 0, nonterms = 0;
+			if (!(ParseTableFile::Read(i, states) && ParseTableFile::Read(i, symbols)
+				&& ParseTableFile::Read(i, nonterms) && ParseTableFile::Read(i, epsilon)
+				&& ParseTableFile::Read(i, productions) && ParseTableFile::Read(i, action_cells)
+				&& ParseTableFile::Read(i, goto_cells)))
+				return false;
+			state_count = (size_t)states;
+			symbol_count = (size_t)symbols;
+			nonterm_count = (size_t)nonterms;
+			if (action_cells.size() != state_count * symbol_count || goto_cells.size() != state_count * nonterm_count)
+				return false;
+			BuildExpects();
+			return true;
+		}
+
+		// not stored, rebuilt from the cells
+		void BuildExpects()
+		{
+			expects.Build(state_count, symbol_count,
+				[this](size_t state, size_t sym) { return !action_cells[state * symbol_count + sym].Error(); });
+		}
+
+		size_t state_count = 0;
+		size_t symbol_count = 0;
+		size_t nonterm_count = 0;
+		uint32_t epsilon = (uint32_t)-1;
+		std::vector<ProductionInfo> productions;
+		std::vector<ActionWord> action_cells;
+		std::vector<uint32_t> goto_cells;
+		ExpectIndex expects;
+	};
+
+	// ACTION and GOTO packed by row displacement, like yacc's tables:
+	// - every state has a default action, the most frequent one in its row, which is not stored
+	// - the other cells of all rows share one comb vector, row i starts at action_base[i],
+	//   a cell belongs to the row whose state is in its check field
+	// - a states x symbols bitset keeps which cells are not error, so errors are detected
+	//   as early as with the dense table and the expected symbols stay exact
+	// - GOTO is packed the same way by nonterm columns, with a default state per nonterm
+	template<typename T>
+	class CompressedParseTable
+	{
+	public:
+		using ActionTable = typename PushDownAutomaton<T>::ActionTable;
+		using GotoTable = typename PushDownAutomaton<T>::GotoTable;
+		static constexpr uint32_t no_state = (uint32_t)-1;
+
+		MU_NOINLINE
+		void Build(const ActionTable& action_table, const GotoTable& goto_table)
+		{
+			DenseParseTable<T> dense;
+			dense.Build(action_table, goto_table);
+			state_count = dense.state_count;
+			symbol_count = dense.symbol_count;
+			nonterm_count = dense.nonterm_count;
+			epsilon = dense.epsilon;
+			productions = dense.productions;
+			dense_size = dense.Size();
+
+			row_words = (symbol_count + 63) / 64;
+			valid.assign(state_count * row_words, 0);
+			default_action.assign(state_count, ActionWord());
+			std::vector<std::vector<Cell>> rows(state_count);
+			for (size_t state = 0; state < state_count; ++state)
+			{
+				auto row = &dense.action_cells[state * symbol_count];
+				std::map<ActionWord, size_t> frequency;
+				for (size_t sym = 0; sym < symbol_count; ++sym)
+					if (!row[sym].Error())
+					{
+						valid[state * row_words + sym / 64] |= 1ull << (sym % 64);
+						++frequency[row[sym]];
+					}
+				size_t most = 0;
+				for (auto& [action, count] : frequency)
+					if (count > most)
+					{
+						most = count;
+						default_action[state] = action;
+					}
+				for (size_t sym = 0; sym < symbol_count; ++sym)
+					if (!row[sym].Error() && row[sym] != default_action[state])
+						rows[state].push_back({ (uint32_t)sym, row[sym] });
+			}
+			action_base = Pack(rows, action_comb);
+
+			default_goto.assign(nonterm_count, no_state);
+			std::vector<std::vector<GotoCell>> columns(nonterm_count);
+			for (size_t nonterm = 0; nonterm < nonterm_count; ++nonterm)
+			{
+				std::map<uint32_t, size_t> frequency;
+				for (size_t state = 0; state < state_count; ++state)
+				{
+					auto next = dense.goto_cells[state * nonterm_count + nonterm];
+					if (next != no_state) ++frequency[next];
+				}
+				size_t most = 0;
+				for (auto& [next, count] : frequency)
+					if (count > most)
+					{
+						most = count;
+						default_goto[nonterm] = next;
+					}
+				for (size_t state = 0; state < state_count; ++state)
+				{
+					auto next = dense.goto_cells[state * nonterm_count + nonterm];
+					if (next != no_state && next != default_goto[nonterm])
+						columns[nonterm].push_back({ (uint32_t)state, next });
+				}
+			}
+			goto_base = Pack(columns, goto_comb);
+			BuildExpects();
+		}
+
+		bool Empty() const { return default_action.empty(); }
+
+		ActionWord Find(size_t state, T sym) const
+		{
+			if (!Valid(state, sym)) return ActionWord();
+			auto index = action_base[state] + (size_t)sym;
+			if (index < action_comb.size() && action_comb[index].check == state)
+				return action_comb[index].value;
+			return default_action[state];
+		}
+
+		size_t Goto(size_t state, T nonterm) const
+		{
+			if ((size_t)nonterm >= nonterm_count)
+				throw(Exception("No GOTO for state " + std::to_string(state) + " and nonterm " + std::to_string((size_t)nonterm)));
+			auto index = goto_base[(size_t)nonterm] + state;
+			if (index < goto_comb.size() && goto_comb[index].check == (uint32_t)nonterm)
+				return goto_comb[index].value;
+			auto next = default_goto[(size_t)nonterm];
+			if (next == no_state)
+				throw(Exception("No GOTO for state " + std::to_string(state) + " and nonterm " + std::to_string((size_t)nonterm)));
+			return next;
+		}
+
+		const ProductionInfo& Production(size_t id) const { return productions[id]; }
+
+		size_t MaxProductionLength() const
+		{
+			size_t length = 0;
+			for (auto& production : productions) length = (std::max)(length, (size_t)production.length);
+			return length;
+		}
+
+		Span<const uint32_t> Expected(size_t state) const { return expects.Of(state); }
+		std::vector<T> Expects(size_t state) const { return expects.ToVector<T>(state); }
+
+		T Epsilon() const { return (T)epsilon; }
+
+		size_t StateCount() const { return state_count; }
+		size_t SymbolCount() const { return symbol_count; }
+
+		size_t Size() const
+		{
+			return productions.size() * sizeof(ProductionInfo)
+				+ valid.size() * sizeof(uint64_t)
+				+ default_action.size() * sizeof(ActionWord)
+				+ (action_base.size() + goto_base.size() + default_goto.size()) * sizeof(uint32_t)
+				+ action_comb.size() * sizeof(Cell) + goto_comb.size() * sizeof(GotoCell)
+				+ expects.Size();
+		}
+
+		// bytes the same tables take as a DenseParseTable
+		size_t DenseSize() const { return dense_size; }
+
+		void Save(std::ostream& o) const
+		{
+			ParseTableFile::WriteHeader(o, ParseTableFile::Compressed);
+			ParseTableFile::Write(o, (uint64_t)state_count);
+			ParseTableFile::Write(o, (uint64_t)symbol_count);
+			ParseTableFile::Write(o, (uint64_t)nonterm_count);
+			ParseTableFile::Write(o, (uint64_t)dense_size);
+			ParseTableFile::Write(o, epsilon);
+			ParseTableFile::Write(o, productions);
+			ParseTableFile::Write(o, valid);
+			ParseTableFile::Write(o, default_action);
+			ParseTableFile::Write(o, action_base);
+			ParseTableFile::Write(o, action_comb);
+			ParseTableFile::Write(o, default_goto);
+			ParseTableFile::Write(o, goto_base);
+			ParseTableFile::Write(o, goto_comb);
+		}
+
+		bool Load(std::istream& i)
+		{
+			uint64_t states = 0, symbols = 0, nonterms = 0, dense = 0;
+			if (!(ParseTableFile::ReadHeader(i, ParseTableFile::Compressed)
+				&& ParseTableFile::Read(i, states) && ParseTableFile::Read(i, symbols)
+				&& ParseTableFile::Read(i, nonterms) && ParseTableFile::Read(i, dense)
+				&& ParseTableFile::Read(i, epsilon) && ParseTableFile::Read(i, productions)
+				&& ParseTableFile::Read(i, valid) && ParseTableFile::Read(i, default_action)
+				&& ParseTableFile::Read(i, action_base) && ParseTableFile::Read(i, action_comb)
+				&& ParseTableFile::Read(i, default_goto) && ParseTableFile::Read(i, goto_base)
+				&& ParseTableFile::Read(i, goto_comb)))
+				return false;
+			state_count = (size_t)states;
+			symbol_count = (size_t)symbols;
+			nonterm_count = (size_t)nonterms;
+			dense_size = (size_t)dense;
+			row_words = (symbol_count + 63) / 64;
+			if (!(valid.size() == state_count * row_words && default_action.size() == state_count
+				&& action_base.size() == state_count && default_goto.size() == nonterm_count
+				&& goto_base.size() == nonterm_count))
+				return false;
+			BuildExpects();
+			return true;
+		}
+
+	private:
+		// row owning the cell: the state in action_comb, the nonterm in goto_comb
+		// while packing, check is the position in the row
+		struct Cell
+		{
+			uint32_t check;
+			ActionWord value;
+		};
+
+		struct GotoCell
+		{
+			uint32_t check;
+			uint32_t value;
+		};
+
+		bool Valid(size_t state, T sym) const
+		{
+			return (size_t)sym < symbol_count && (valid[state * row_words + (size_t)sym / 64] >> ((size_t)sym % 64)) & 1;
+		}
+
+		// not stored, rebuilt from the valid bitset
+		void BuildExpects()
+		{
+			expects.Build(state_count, symbol_count, [this](size_t state, size_t sym) { return Valid(state, (T)sym); });
+		}
+
+		// first fit, the fullest rows first
+		template<class C>
+		MU_NOINLINE
+		static std::vector<uint32_t> Pack(const std::vector<std::vector<C>>& rows, std::vector<C>& comb)
+		{
+			std::vector<uint32_t> base(rows.size(), 0);
+			std::vector<size_t> order(rows.size());
+			for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+			std::stable_sort(order.begin(), order.end(),
+				[&rows](size_t a, size_t b) { return rows[a].size() > rows[b].size(); });
+			comb.clear();
+			std::vector<bool> used;
+			size_t first_free = 0;
+			for (auto row : order)
+			{
+				auto& cells = rows[row];
+				if (cells.empty()) continue;
+				while (first_free < used.size() && used[first_free]) ++first_free;
+				auto offset = first_free > cells[0].check ? first_free - cells[0].check : 0;
+				while (true)
+				{
+					bool fit = true;
+					for (auto& cell : cells)
+					{
+						auto index = offset + cell.check;
+						if (index < used.size() && used[index])
+						{
+							fit = false;
+							break;
+						}
+					}
+					if (fit) break;
+					++offset;
+				}
+				auto end = offset + cells.back().check + 1;
+				if (end > used.size())
+				{
+					used.resize(end, false);
+					comb.resize(end, { no_state, {} });
+				}
+				for (auto& cell : cells)
+				{
+					used[offset + cell.check] = true;
+					comb[offset + cell.check] = { (uint32_t)row, cell.value };
+				}
+				base[row] = (uint32_t)offset;
+			}
+			return base;
+		}
+
+		size_t state_count = 0;
+		size_t symbol_count = 0;
+		size_t nonterm_count = 0;
+		size_t row_words = 0;
+		size_t dense_size = 0;
+		uint32_t epsilon = (uint32_t)-1;
+		std::vector<ProductionInfo> productions;
+		std::vector<uint64_t> valid;
+		std::vector<ActionWord> default_action;
+		std::vector<uint32_t> action_base;
+		std::vector<Cell> action_comb;
+		std::vector<uint32_t> default_goto;
+		std::vector<uint32_t> goto_base;
+		std::vector<GotoCell> goto_comb;
+		ExpectIndex expects;
+	};
+}
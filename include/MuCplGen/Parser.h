@@ -1,12 +1,13 @@
 #pragma once
 #include <functional>
-#include <stack>
 #include <vector>
 #include <type_traits>
 #include <any>
 #include "Platform.h"
 #include "FileSystem.h"
 #include "PushDownAutomaton.h"
+#include "ParseTable.h"
+#include "Span.h"
 #include "Token.h"
 #include "DebugTool/DebugOption.h"
 #include "MuException.h"
@@ -26,7 +27,8 @@ namespace MuCplGen
 		std::any data;
 	};
 
-	template<class UserToken, typename T = size_t>
+	// Table: DenseParseTable, or CompressedParseTable for grammars with many states and terminals
+	template<class UserToken, typename T = size_t, template<typename> class Table = DenseParseTable>
 	class BaseParser
 	{
 		template<class Parser>
@@ -40,10 +42,11 @@ namespace MuCplGen
 		using ActionTable = typename PushDownAutomaton<T>::ActionTable;
 		using Action = typename PushDownAutomaton<T>::Action;
 		using ProductionTable = typename PushDownAutomaton<T>::ProductionTable;
+		using Grammar = typename PushDownAutomaton<T>::Grammar;
 		using FollowTable = typename PushDownAutomaton<T>::FollowTable;
 		using State = size_t;
-		GotoTable goto_table;
-		ActionTable action_table;
+		// built by SetUp from the ACTION and GOTO hash tables, which are dropped afterwards
+		Table<T> parse_table;
 		
 		void ModifyTokenPointer(size_t  pointer)
 		{
@@ -57,56 +60,111 @@ namespace MuCplGen
 		bool ptr_updated = false;
 		size_t token_pointer = 0;
 		size_t debug_option = 0;
-		std::stack<State> state_stack;
-		std::stack<std::any*> semantic_stack;
-		std::stack<std::any*> help_stack;
-		std::vector<std::any*> pass;
+		// vectors keep their capacity across parses, see ReserveStacks
+		std::vector<State> state_stack;
+		std::vector<std::any*> semantic_stack;
 	public:
 		std::string information;
 		std::string parser_name;
 
-		virtual void SetUp(const ProductionTable& production_table,
+		virtual void SetUp(const Grammar& grammar,
 			const T last_term, const T end_symbol,
 			const T epsilon, const T first) = 0;
+
+		void SetUp(const ProductionTable& production_table,
+			const T last_term, const T end_symbol,
+			const T epsilon, const T first)
+		{
+			SetUp(Grammar(production_table), last_term, end_symbol, epsilon, first);
+		}
 		
 		void Reset()
 		{
-			while (!state_stack.empty())
-				state_stack.pop();
-			state_stack.push(0);
+			state_stack.clear();
+			semantic_stack.clear();
+			state_stack.push_back(0);
+		}
+
+		// sizes the stacks up front: a few of the longest productions deep, plus some depth per token
+		// left-recursive lists stay shallow, so only a fraction of token_count is reserved
+		void ReserveStacks(size_t token_count = 0)
+		{
+			auto depth = 64 + 4 * parse_table.MaxProductionLength() + token_count / 8;
+			state_stack.reserve(depth);
+			semantic_stack.reserve(depth);
+		}
+
+		// the symbols the parser can take in its current state, e.g. for completion after a partial input
+		// read from a list built with the table, not from the table row
+		Span<const uint32_t> ExpectedSymbols() const
+		{
+			if (state_stack.empty()) return parse_table.Expected(0);
+			return parse_table.Expected(state_stack.back());
 		}
 
 		using TransferFunc = std::function<T(const Token&)>;
-		using SemanticAction = std::function<std::any* (std::vector<std::any*>, size_t, size_t, size_t)>;
+		// the values of the production body, in place on the semantic stack, valid until the action returns
+		using SemanticAction = std::function<std::any* (Span<std::any*>, size_t, size_t, size_t)>;
 		using ErrorFunc = std::function<void(std::vector<T>, size_t)>;
 
+		// transfer_at(i) gives the terminator of token i, or no_token after the last token
+		using TransferAtFunc = std::function<T(size_t)>;
+		static constexpr T no_token = (T)-1;
+
 		virtual bool Parse(const BaseParser::TokenSet& token_set, BaseParser::TransferFunc transfer_func,
 			SemanticAction semantic_action, ErrorFunc error_func = nullptr, std::ostream& log = std::cout)
 		{
-			auto len = token_set.size();
+			return ParseAt(
+				[&token_set, &transfer_func](size_t i) { return i < token_set.size() ? transfer_func(token_set[i]) : no_token; },
+				std::move(semantic_action), std::move(error_func), log);
+		}
+
+		// tokens are only asked for by index, so they may be pulled from a TokenStream as the parser shifts
+		virtual bool ParseAt(BaseParser::TransferAtFunc transfer_at,
+			SemanticAction semantic_action, ErrorFunc error_func = nullptr, std::ostream& log = std::cout)
+		{
+			return Run(transfer_at, semantic_action, error_func, log);
+		}
+
+		// Parse taking the callables by type instead of std::function, so they can be inlined into the loop:
+		// transfer(token) -> T, semantic_action(Span<std::any*>, nonterm, production_index, token_iter) -> std::any*,
+		// error_func(std::vector<T> expects, token_iter), or nullptr
+		template<class Transfer, class Semantic, class Error = std::nullptr_t>
+		bool Parse(const TokenSet& token_set, Transfer&& transfer,
+			Semantic&& semantic_action, Error&& error_func = nullptr, std::ostream& log = std::cout)
+		{
+			return Run([&token_set, &transfer](size_t i) { return i < token_set.size() ? (T)transfer(token_set[i]) : no_token; },
+				semantic_action, error_func, log);
+		}
+
+		// the parse loop behind Parse and ParseAt, transfer_at(i) gives the terminator of token i as in ParseAt
+		// the lookahead is read again after every reduce, since a semantic action may retag it
+		template<class TransferAt, class Semantic, class Error = std::nullptr_t>
+		bool Run(TransferAt&& transfer_at, Semantic&& semantic_action, Error&& error_func = nullptr, std::ostream& log = std::cout)
+		{
 			size_t top_token_iter = token_pointer;
 			size_t iter = token_pointer;
 			bool on = true;
 			bool acc = false;
+			if (parse_table.Empty()) throw Exception("Check if you call Build() in your constructor.");
 			while (on)
 			{
-				if (iter >= token_set.size())
+				if (state_stack.size() == 0) throw Exception("Check if you call Build() in your constructor.");
+				T input_term = transfer_at(iter);
+				if (input_term == no_token)
 				{
 					if (debug_option & DebugOption::ParserDetail)
 						log << "tokens run out without an EndToken" << std::endl;
 					break;
 				}
-				if (state_stack.size() == 0) throw Exception("Check if you call Build() in your constructor.");
-				T input_term = transfer_func(token_set[iter]);
-				auto action_iter = action_table.find({ state_stack.top(),input_term });
-				if (action_table.find({ state_stack.top(),input_term }) != action_table.end())
+				auto action = parse_table.Find(state_stack.back(), input_term);
+				if (!action.Error())
 				{
-					auto& action = std::get<1>(*action_iter);
-					switch (action.type)
+					switch (action.Type())
 					{
 					case ActionType::move_in:
-						state_stack.push(action.aim_state);
-						semantic_stack.push(nullptr);
+						state_stack.push_back(action.Value());
+						semantic_stack.push_back(nullptr);
 						top_token_iter = iter;
 						if (ptr_updated)
 						{
@@ -115,25 +173,27 @@ namespace MuCplGen
 						}
 						else ++iter;
 						if (debug_option & DebugOption::ParserDetail)
-							log << "move_in state:" << action.aim_state << " term: " << action.sym << std::endl;
+							log << "move_in state:" << action.Value() << " term: " << input_term << std::endl;
 						break;
 					case ActionType::move_epsilon:
-						state_stack.push(action.aim_state);
-						semantic_stack.push(nullptr);
+						state_stack.push_back(action.Value());
+						semantic_stack.push_back(nullptr);
 						top_token_iter = iter;
 						if (debug_option & DebugOption::ParserDetail)
-							log << "move_epsilon state:" << action.aim_state << " term: " << action.sym << std::endl;
+							log << "move_epsilon state:" << action.Value() << " term: " << parse_table.Epsilon() << std::endl;
 						break;
 					case ActionType::reduce:
 					{
-						SortStack(action);
-						auto goto_state = goto_table[{state_stack.top(), action.sym}];
-						state_stack.push(goto_state);
+						auto& production = parse_table.Production(action.Value());
+						auto body = PopStates(production.length);
+						auto goto_state = parse_table.Goto(state_stack.back(), (T)production.head);
+						state_stack.push_back(goto_state);
 						if (debug_option & DebugOption::ParserDetail)
-							log << "reduce: nonterm" << action.sym << "\n"
-							<< "\tpop amount: " << action.production_length
+							log << "reduce: nonterm" << production.head << "\n"
+							<< "\tpop amount: " << production.length
 							<< " push state: " << goto_state << std::endl;
-						auto back = semantic_action(std::move(pass), (size_t)action.sym, action.production_index, top_token_iter);
+						auto back = semantic_action(body, production.head, production.index, top_token_iter);
+						semantic_stack.resize(semantic_stack.size() - production.length);
 						if (auto cast = std::any_cast<ParserErrorData>(back))
 						{
 							switch (cast->code)
@@ -146,19 +206,21 @@ namespace MuCplGen
 							default:
 								if (debug_option & DebugOption::ParserDetail)
 									log << ":Parser Going On with Error Code" << std::endl;
-								semantic_stack.push(back);
+								semantic_stack.push_back(back);
 								break;
 							}
 						}
-						else semantic_stack.push(back);
+						else semantic_stack.push_back(back);
 						break;
 					}
 					case ActionType::accept:
-						SortStack(action);
+					{
+						auto& production = parse_table.Production(action.Value());
+						auto body = PopStates(production.length);
 						on = false;
-						semantic_stack.push(
-							semantic_action(std::move(pass), (size_t)action.sym, action.production_index, top_token_iter)
-						);
+						auto back = semantic_action(body, production.head, production.index, top_token_iter);
+						semantic_stack.resize(semantic_stack.size() - production.length);
+						semantic_stack.push_back(back);
 						if (debug_option & DebugOption::ParserDetail)
 						{
 							SetConsoleColor(log, ConsoleForegroundColor::Yellow, ConsoleBackgroundColor::Blue);
@@ -169,53 +231,62 @@ namespace MuCplGen
 						}
 						acc = true;
 						break;
+					}
 					default:
 						assert(0);
 						break;
 					}
 				}
-				else if (error_func)
+				else
 				{
 					if (debug_option & DebugOption::ParserError)
 						log << parser_name << ":Parser Error" << std::endl;
-					std::vector<T> expects;
-					for (const auto& item : action_table)
-						if (std::get<0>(item.first) == state_stack.top())
-							expects.push_back(std::get<1>(item.first));
-					error_func(std::move(expects), iter);
+					if constexpr (!std::is_same_v<std::decay_t<Error>, std::nullptr_t>)
+						if (HasCallback(error_func)) error_func(parse_table.Expects(state_stack.back()), iter);
 					break;
 				}
 			}
 			return acc;
 		}
 
-		MU_NOINLINE
-		void SortStack(Action& action)
+		// false for an empty std::function or function pointer
+		template<class F>
+		static bool HasCallback(const F& f)
 		{
-			pass.clear();
-			for (size_t i = 0; i < action.production_length; i++)
-			{
-				state_stack.pop();
-				help_stack.push(semantic_stack.top());
-				semantic_stack.pop();
-			}
-			for (size_t i = 0; i < action.production_length; i++)
-			{
-				pass.push_back(help_stack.top());
-				help_stack.pop();
-			}
+			if constexpr (std::is_constructible_v<bool, const F&>) return (bool)f;
+			else return true;
+		}
+
+		// pops the states of a production body, its values stay on the semantic stack for the action to read
+		Span<std::any*> PopStates(size_t production_length)
+		{
+			state_stack.resize(state_stack.size() - production_length);
+			return Span<std::any*>(semantic_stack.data() + semantic_stack.size() - production_length, production_length);
+		}
+
+		// size of the table ParseAt reads, against the same table stored dense
+		void ReportParseTable(std::ostream& log = std::cout)
+		{
+			log << parser_name << " table: " << parse_table.StateCount() << " states x "
+				<< parse_table.SymbolCount() << " symbols, " << parse_table.Size() << " bytes";
+			if (parse_table.Size() != parse_table.DenseSize())
+				log << " (dense: " << parse_table.DenseSize() << " bytes)";
+			log << std::endl;
 		}
 
-		virtual void Save(const std::string& path)
+		// the table is stored after the hash of the grammar it is built from (Grammar::Hash),
+		// Load rejects a table whose hash is not grammar_hash
+		virtual void Save(const std::string& path, size_t grammar_hash = 0)
 		{
 			FileSystem::path p(path);
 			auto dir = p.parent_path();
 			if(!FileSystem::exists(dir)) FileSystem::create_directory(dir);
 			std::ofstream o(path, std::ios::binary);
-			o << action_table << goto_table;
+			ParseTableFile::Write(o, (uint64_t)grammar_hash);
+			parse_table.Save(o);
 		}
 
-		virtual bool Load(const std::string& path)
+		virtual bool Load(const std::string& path, size_t grammar_hash = 0)
 		{
 			auto error = true;
 			if(FileSystem::exists(path))
@@ -223,8 +294,9 @@ namespace MuCplGen
 				try
 				{
 					std::ifstream i(path, std::ios::binary);
-					i >> action_table >> goto_table;
-					error = false;
+					uint64_t stored_hash = 0;
+					error = !(ParseTableFile::Read(i, stored_hash) && stored_hash == (uint64_t)grammar_hash
+						&& parse_table.Load(i));
 				}
 				catch (std::exception e)
 				{
@@ -236,11 +308,11 @@ namespace MuCplGen
 	};
 
 
-	template<class UserToken, typename T = size_t>
-	class SLRParser : public BaseParser<UserToken, T>
+	template<class UserToken, typename T = size_t, template<typename> class Table = DenseParseTable>
+	class SLRParser : public BaseParser<UserToken, T, Table>
 	{
 	private:
-		using Base = BaseParser<UserToken, T>;
+		using Base = BaseParser<UserToken, T, Table>;
 		using CollectionOfItemSets = typename PushDownAutomaton<T>::CollectionOfItemSets;
 	public:
 		SLRParser() { this->parser_name = "SLR Parser"; }
@@ -251,34 +323,80 @@ namespace MuCplGen
 			const T epsilon, const T first = (T)0)
 			: SLRParser()
 		{
-			static_assert(std::is_base_of_v<BaseToken, UserToken>, "Your Token should be drived from BaseToken");
+			static_assert(IsToken_v<UserToken>, "Your Token should be drived from BaseToken or ViewToken, or be CompactToken");
 			SetUp(production_table, last_term, end_symbol, epsilon, first);
 		}
 
+		using Base::SetUp;
+
 		MU_NOINLINE
-		void SetUp(const typename Base::ProductionTable& production_table,
+		void SetUp(const typename Base::Grammar& grammar,
 			const T last_term, const T end_symbol,
 			const T epsilon, const T first) override
 		{
 			auto first_table = PushDownAutomaton<T>::FIRST(
-				production_table, epsilon, last_term, first);
+				grammar, epsilon, last_term, first);
 			auto follow_table = PushDownAutomaton<T>::FOLLOW(
-				first_table, production_table, epsilon, end_symbol, first);
+				first_table, grammar, epsilon, end_symbol, first);
 			auto back = PushDownAutomaton<T>::COLLECTION(
-				production_table, epsilon, end_symbol, first);
-			auto item_collection = std::get<0>(back);
-			this->goto_table = std::get<1>(back);
-			this->action_table = PushDownAutomaton<T>::SetActionTable(
-				production_table, item_collection, this->goto_table, follow_table,
+				grammar, epsilon, end_symbol, first);
+			auto& item_collection = std::get<0>(back);
+			auto& goto_table = std::get<1>(back);
+			auto action_table = PushDownAutomaton<T>::SetActionTable(
+				grammar, item_collection, goto_table, follow_table,
 				epsilon, end_symbol, first);
+			this->parse_table.Build(action_table, goto_table);
 		}
 	};
 
-	template<class UserToken, typename T = size_t>
-	class LR1Parser : public BaseParser<UserToken, T>
+	// SLR's LR(0) states with LR(1)'s lookaheads where the two differ:
+	// the lookaheads are computed over the LR(0) collection with DeRemer and Pennello's relations
+	template<class UserToken, typename T = size_t, template<typename> class Table = DenseParseTable>
+	class LALRParser : public BaseParser<UserToken, T, Table>
 	{
 	private:
-		using Base = BaseParser<UserToken, T>;
+		using Base = BaseParser<UserToken, T, Table>;
+	public:
+		LALRParser() { this->parser_name = "LALR Parser"; }
+
+		LALRParser(
+			const typename Base::ProductionTable& production_table,
+			const T last_term, const T end_symbol,
+			const T epsilon, const T first = (T)0)
+			: LALRParser()
+		{
+			static_assert(IsToken_v<UserToken>, "Your Token should be drived from BaseToken or ViewToken, or be CompactToken");
+			SetUp(production_table, last_term, end_symbol, epsilon, first);
+		}
+
+		using Base::SetUp;
+
+		MU_NOINLINE
+		void SetUp(const typename Base::Grammar& grammar,
+			const T last_term, const T end_symbol,
+			const T epsilon, const T first) override
+		{
+			auto first_table = PushDownAutomaton<T>::FIRST(
+				grammar, epsilon, last_term, first);
+			auto back = PushDownAutomaton<T>::COLLECTION(
+				grammar, epsilon, end_symbol, first);
+			auto& item_collection = std::get<0>(back);
+			auto& goto_table = std::get<1>(back);
+			auto lookaheads = PushDownAutomaton<T>::LALR_LOOKAHEADS(
+				grammar, first_table, item_collection, goto_table,
+				epsilon, end_symbol, first);
+			auto action_table = PushDownAutomaton<T>::SetActionTable(
+				grammar, item_collection, goto_table, lookaheads,
+				epsilon, end_symbol, first);
+			this->parse_table.Build(action_table, goto_table);
+		}
+	};
+
+	template<class UserToken, typename T = size_t, template<typename> class Table = DenseParseTable>
+	class LR1Parser : public BaseParser<UserToken, T, Table>
+	{
+	private:
+		using Base = BaseParser<UserToken, T, Table>;
 		using LR1Collection = typename PushDownAutomaton<T>::LR1Collection;
 	public:
 		LR1Parser() { this->parser_name = "LR1 Parser"; }
@@ -289,29 +407,32 @@ namespace MuCplGen
 			const T epsilon, const T first = (T)0)
 			:LR1Parser()
 		{
-			static_assert(std::is_base_of_v<BaseToken, UserToken>, "Your Token should be drived from BaseToken");
+			static_assert(IsToken_v<UserToken>, "Your Token should be drived from BaseToken or ViewToken, or be CompactToken");
 			SetUp(production_table, last_term, end_symbol, epsilon, first);
 		}
 
 		~LR1Parser() {}
 
+		using Base::SetUp;
+
 		MU_NOINLINE
 		void SetUp(
-			const typename Base::ProductionTable& production_table,
+			const typename Base::Grammar& grammar,
 			const T last_term, const T end_symbol,
 			const T epsilon, const T first) override
 		{
 			auto first_table = PushDownAutomaton<T>::FIRST(
-				production_table, epsilon, last_term, first);
+				grammar, epsilon, last_term, first);
 			auto follow_table = PushDownAutomaton<T>::FOLLOW(
-				first_table, production_table, epsilon, end_symbol, first);
+				first_table, grammar, epsilon, end_symbol, first);
 			auto back = PushDownAutomaton<T>::COLLECTION_LR(
-				production_table, first_table, epsilon, end_symbol, first);
-			auto item_collection = std::get<0>(back);
-			this->goto_table = std::get<1>(back);
-			this->action_table = PushDownAutomaton<T>::SetActionTable(
-				production_table, item_collection, this->goto_table, follow_table,
+				grammar, first_table, epsilon, end_symbol, first);
+			auto& item_collection = std::get<0>(back);
+			auto& goto_table = std::get<1>(back);
+			auto action_table = PushDownAutomaton<T>::SetActionTable(
+				grammar, item_collection, goto_table, follow_table,
 				epsilon, end_symbol, first);
+			this->parse_table.Build(action_table, goto_table);
 		}
 	};
 }
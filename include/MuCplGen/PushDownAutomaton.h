@@ -2,8 +2,14 @@
 #include <vector>
 #include <unordered_map>
 #include <set>
+#include <map>
+#include <tuple>
+#include <algorithm>
 #include <cassert>
 #include "MuException.h"
+#include "BitSet.h"
+#include "Grammar.h"
+#include "ThreadPool.h"
 
 namespace MuCplGen
 {
@@ -43,11 +49,15 @@ namespace MuCplGen
 
 		using ProductionTable = std::vector<Productions>;
 
+		// what the table builders run on, see Grammar.h
+		using Grammar = MuCplGen::Grammar<T>;
+
 		// A: a0,a1,...
 		// B: b0,b1,...
 		// ...
-		using FirstTable = std::vector<std::set<T>>;
-		using FollowTable = std::vector<std::set<T>>;
+		// bitsets over the symbols, FIRST(X) holds epsilon if X derives epsilon
+		using FirstTable = std::vector<BitSet>;
+		using FollowTable = std::vector<BitSet>;
 
 		// SELECT(A -> a) = {a1,a2,...}
 		// Select_Table[nonterm][production] => set of term;
@@ -123,50 +133,28 @@ namespace MuCplGen
 			}
 		};
 
-		struct LR1Item
+		// an LR1 item set, the kernel items first and then the closure items,
+		// lookaheads[i] holds the LAterms of items[i]
+		struct LR1ItemSet
 		{
-			// to get Productions in Production_Table
-			T nonterm;
-			// to get certain production
-			size_t production_index;
-			// A->a.Bb
-			size_t point_pos;
-
-			T LAterm;
-
-			bool operator == (const Item& obj)
-			{
-				return nonterm == obj.nonterm
-					&& production_index == obj.production_index
-					&& point_pos == obj.point_pos;
-			}
-
-			bool operator < (const LR1Item& rhs) const
-			{
-				if (nonterm < rhs.nonterm) return true;
-				if (nonterm == rhs.nonterm
-					&& production_index < rhs.production_index)
-					return true;
-				if (nonterm == rhs.nonterm
-					&& production_index == rhs.production_index
-					&& point_pos < rhs.point_pos)
-					return true;
-				return false;
-			}
+			std::vector<Item> items;
+			std::vector<BitSet> lookaheads;
+			size_t kernel_size = 0;
+		};
 
-			bool operator == (const LR1Item& rhs) const
-			{
-				return nonterm == rhs.nonterm
-					&& production_index == rhs.production_index
-					&& point_pos == rhs.point_pos
-					&& LAterm == rhs.LAterm;
-			}
+		// FIRST of every production suffix, for the LAterms of LR1 items:
+		// firsts[A][production_index][pos] is FIRST(production[pos..]) without epsilon,
+		// nullable[A][production_index][pos] if production[pos..] derives epsilon
+		struct SuffixFirstTable
+		{
+			std::vector<std::vector<std::vector<BitSet>>> firsts;
+			std::vector<std::vector<std::vector<bool>>> nullable;
 		};
 
 		// for LR0
 		using CollectionOfItemSets = std::vector<SimplifiedSetOfItems>;
 
-		using LR1Collection = std::vector<std::vector<LR1Item>>;
+		using LR1Collection = std::vector<LR1ItemSet>;
 
 		struct GotoHash
 		{
@@ -328,29 +316,30 @@ namespace MuCplGen
 			}
 		}
 
+		static FirstTable FIRST(
+			const Grammar& grammar,
+			const T epsilon, const T last_term, const T first = (T)0);
+
 		static FirstTable FIRST(
 			const ProductionTable& production_table,
 			const T epsilon, const T last_term, const T first = (T)0)
 		{
-			auto int_last = (int)last_term;
-			auto int_first = (int)first;
-			FirstTable ret(int_last + 1);
-			bool changed = true;
-			while (changed)
-			{
-				changed = false;
-				//do until First_Table no longer changes;
-				for (int i = int_last; i >= int_first; --i)
-					setup_first_table(changed, ret, production_table, epsilon, (T)i);
-			}
-			return ret;
+			return FIRST(Grammar(production_table), epsilon, last_term, first);
 		}
 
 		static FollowTable FOLLOW(
 			const FirstTable& first_table,
-			const ProductionTable& production_table,
+			const Grammar& grammar,
 			const T epsilon, const T end_symbol, const T first_nonterm = (T)0);
 
+		static FollowTable FOLLOW(
+			const FirstTable& first_table,
+			const ProductionTable& production_table,
+			const T epsilon, const T end_symbol, const T first_nonterm = (T)0)
+		{
+			return FOLLOW(first_table, Grammar(production_table), epsilon, end_symbol, first_nonterm);
+		}
+
 		static SelectTable SELECT(
 			const FirstTable& first_table,
 			const FollowTable& follow_table,
@@ -365,79 +354,174 @@ namespace MuCplGen
 		static LL1Table Preanalysis(
 			const FirstTable& first_table,
 			const FollowTable& follow_table,
-			const ProductionTable& production_table,
+			const Grammar& grammar,
 			const T epsilon, const T end_symbol, const T first_nonterm = (T)0);
 
-		static SimplifiedSetOfItems CLOSURE(
+		static LL1Table Preanalysis(
+			const FirstTable& first_table,
+			const FollowTable& follow_table,
 			const ProductionTable& production_table,
+			const T epsilon, const T end_symbol, const T first_nonterm = (T)0)
+		{
+			return Preanalysis(first_table, follow_table, Grammar(production_table), epsilon, end_symbol, first_nonterm);
+		}
+
+		static SimplifiedSetOfItems CLOSURE(
+			const Grammar& grammar,
 			const std::set<Item> cores,
 			const T& epsilon, const T& start = (T)0);
 
 
 		static SimplifiedSetOfItems CLOSURE(
-			const ProductionTable& production_table,
+			const Grammar& grammar,
 			const SimplifiedSetOfItems& I,
 			const T& epsilon, const T& start = (T)0)
 		{
-			return CLOSURE(production_table, I.cores, epsilon, start);
+			return CLOSURE(grammar, I.cores, epsilon, start);
 		}
 
-		static void CLOSURE(
-			std::vector<LR1Item>& I,
-			const ProductionTable& production_table,
+		static SuffixFirstTable SUFFIX_FIRST(
+			const Grammar& grammar,
 			const FirstTable& first_table,
-			const T& epsilon, const T& start = (T)0);
+			const T& epsilon, const T& end);
+
+		// closes I in place, the lookaheads of its items propagate until nothing changes
+		static void CLOSURE(
+			LR1ItemSet& I,
+			const Grammar& grammar,
+			const SuffixFirstTable& suffix_first_table,
+			const T& epsilon);
 
 		static SimplifiedSetOfItems GOTO(
-			const ProductionTable& production_table,
+			const Grammar& grammar,
 			const SimplifiedSetOfItems& I,
 			const T& symbol, const T& epsilon, const T& start = (T)0);
 
-		static std::vector<LR1Item> GOTO(
-			const ProductionTable& production_table,
+		// the states are expanded a wave at a time, the gotos and closures of a wave run on pool,
+		// the new states are numbered in the order of (state, symbol) as if expanded one by one
+		static std::tuple<LR1Collection, GotoTable> COLLECTION_LR(
+			const Grammar& grammar,
 			const FirstTable& first_table,
-			const std::vector<LR1Item>& I,
-			const T& symbol, const T& epsilon, const T& start = (T)0);
+			const T& epsilon, const T& end, const T& start = (T)0,
+			ThreadPool& pool = ThreadPool::Global());
 
 		static std::tuple<LR1Collection, GotoTable> COLLECTION_LR(
 			const ProductionTable& production_table,
 			const FirstTable& first_table,
-			const T& epsilon, const T& end, const T& start = (T)0);
+			const T& epsilon, const T& end, const T& start = (T)0,
+			ThreadPool& pool = ThreadPool::Global())
+		{
+			return COLLECTION_LR(Grammar(production_table), first_table, epsilon, end, start, pool);
+		}
+
+		// expanded like COLLECTION_LR
+		static std::tuple<CollectionOfItemSets, GotoTable> COLLECTION(
+			const Grammar& grammar,
+			const T& epsilon, const T& end, const T& start = (T)0,
+			ThreadPool& pool = ThreadPool::Global());
 
 		static std::tuple<CollectionOfItemSets, GotoTable> COLLECTION(
 			const ProductionTable& production_table,
-			const T& epsilon, const T& end, const T& start = (T)0);
+			const T& epsilon, const T& end, const T& start = (T)0,
+			ThreadPool& pool = ThreadPool::Global())
+		{
+			return COLLECTION(Grammar(production_table), epsilon, end, start, pool);
+		}
 
 		static ActionTable SetActionTable(
-			const ProductionTable& production_table,
+			const Grammar& grammar,
 			const LR1Collection& collection,
 			const GotoTable& goto_table,
 			const FollowTable& follow_table,
 			const T& epsilon, const T& end, const T& start = (T)0);
 
 		static ActionTable SetActionTable(
-			const ProductionTable& production_table,
+			const Grammar& grammar,
 			const CollectionOfItemSets& collection,
 			const GotoTable& goto_table,
 			const FollowTable& follow_table,
 			const T& epsilon, const T& end, const T& start = (T)0);
-	private:
-		// term > epsilon > nonterm
-		static void setup_first_table(
-			bool& changed,
-			FirstTable& first_table,
-			const ProductionTable& production_table,
-			const T epsilon, const T Sym);
 
-		// for certain A -> aBb
-		// beta_start_index>=length of production X->aBb,means X -> aB
-		static void set_follow_of_X_with_certain_beta(
-			bool& changed,
+
+		// LALR(1) lookaheads of the LR(0) collection
+		struct LALRLookaheads
+		{
+			// reduce[state][{head, production_index}]: terms to reduce on, for the complete cores of state
+			std::vector<std::map<std::pair<T, int>, std::set<T>>> reduce;
+			// move_epsilon[state]: terms to move epsilon on
+			std::vector<std::set<T>> move_epsilon;
+		};
+
+		// DeRemer and Pennello's relations over the nonterm transitions of the LR(0) collection,
+		// move_epsilon is taken as a transition on a nullable nonterm
+		static LALRLookaheads LALR_LOOKAHEADS(
+			const Grammar& grammar,
 			const FirstTable& first_table,
-			FollowTable& follow_table,
+			const CollectionOfItemSets& collection,
+			const GotoTable& goto_table,
+			const T& epsilon, const T& end, const T& start = (T)0);
+
+		static LALRLookaheads LALR_LOOKAHEADS(
 			const ProductionTable& production_table,
-			const T epsilon, const T sym_A,
-			const int production_index, const int pos_B);
+			const FirstTable& first_table,
+			const CollectionOfItemSets& collection,
+			const GotoTable& goto_table,
+			const T& epsilon, const T& end, const T& start = (T)0)
+		{
+			return LALR_LOOKAHEADS(Grammar(production_table), first_table, collection, goto_table, epsilon, end, start);
+		}
+
+		static ActionTable SetActionTable(
+			const Grammar& grammar,
+			const CollectionOfItemSets& collection,
+			const GotoTable& goto_table,
+			const LALRLookaheads& lookaheads,
+			const T& epsilon, const T& end, const T& start = (T)0);
+
+		// any of the SetActionTable above, from a ProductionTable
+		template<class Collection, class Lookaheads>
+		static ActionTable SetActionTable(
+			const ProductionTable& production_table,
+			const Collection& collection,
+			const GotoTable& goto_table,
+			const Lookaheads& lookaheads,
+			const T& epsilon, const T& end, const T& start = (T)0)
+		{
+			return SetActionTable(Grammar(production_table), collection, goto_table, lookaheads, epsilon, end, start);
+		}
+	private:
+		// LR1 states are told apart by their kernels, lookaheads included
+		static size_t kernel_hash(const LR1ItemSet& I);
+		static bool same_kernel(const LR1ItemSet& lhs, const LR1ItemSet& rhs);
+		// LR0 states by their cores
+		static size_t cores_hash(const std::set<Item>& cores);
+
+		// the kernel of GOTO(I, X) for every X after a point, in the order of X
+		static std::vector<std::pair<T, LR1ItemSet>> goto_kernels(
+			const Grammar& grammar,
+			const LR1ItemSet& I);
+
+		// every X after a point in I, in order
+		static std::vector<T> goto_symbols(
+			const Grammar& grammar,
+			const SimplifiedSetOfItems& I);
+
+		// F(x) = F(x) + F(y) for every y that x reaches through edges, each strongly connected component shares one F
+		static void digraph(
+			const std::vector<std::vector<size_t>>& edges,
+			std::vector<std::set<T>>& F);
+
+		static void digraph_traverse(
+			size_t x,
+			const std::vector<std::vector<size_t>>& edges,
+			std::vector<std::set<T>>& F,
+			std::vector<size_t>& depth,
+			std::vector<size_t>& stack);
+
+		// sets[user] |= sets[x] for every user of x, until nothing changes
+		static void propagate(
+			std::vector<BitSet>& sets,
+			const std::vector<std::vector<size_t>>& users);
 	};
 
 	/*		ActionType type = ActionType::error;
@@ -473,87 +557,182 @@ namespace MuCplGen
 		return out;
 	}
 
+	template<typename T>
+	typename PushDownAutomaton<T>::FirstTable PushDownAutomaton<T>::FIRST(
+		const Grammar& grammar,
+		const T epsilon, const T last_term, const T first)
+	{
+		auto symbol_count = (size_t)last_term + 1;
+		FirstTable ret(symbol_count, BitSet(symbol_count));
+		// FIRST(a) = {a}, FIRST(epsilon) = {epsilon}
+		for (size_t sym = (size_t)epsilon; sym < symbol_count; ++sym) ret[sym].Set(sym);
+
+		// nullable: A -> Y1Y2...Yk derives epsilon once none of Y1...Yk is left,
+		// an occurrence of Yj is ticked off when Yj turns out nullable
+		std::vector<std::vector<size_t>> occurrences((size_t)epsilon);
+		std::vector<size_t> left(grammar.ProductionCount(), 0);
+		std::vector<size_t> work;
+		for (size_t p = grammar.nonterm_begin[first]; p < grammar.ProductionCount(); ++p)
+		{
+			auto A = grammar.heads[p];
+			for (auto Y : grammar.Body(p))
+			{
+				if (Y == epsilon) continue;
+				++left[p];
+				if (Y < epsilon) occurrences[Y].push_back(p);
+			}
+			if (left[p] == 0 && !ret[A].Test(epsilon))
+			{
+				ret[A].Set(epsilon);
+				work.push_back(A);
+			}
+		}
+		while (!work.empty())
+		{
+			auto Y = work.back();
+			work.pop_back();
+			for (auto p : occurrences[Y])
+			{
+				auto A = grammar.heads[p];
+				if (--left[p] == 0 && !ret[A].Test(epsilon))
+				{
+					ret[A].Set(epsilon);
+					work.push_back(A);
+				}
+			}
+		}
+
+		// FIRST(A) includes FIRST(Yj) for every Yj up to the first one that doesn't derive epsilon
+		FirstTable terms((size_t)epsilon, BitSet(symbol_count));
+		std::vector<std::vector<size_t>> users((size_t)epsilon);
+		for (size_t p = grammar.nonterm_begin[first]; p < grammar.ProductionCount(); ++p)
+		{
+			auto A = grammar.heads[p];
+			for (auto Y : grammar.Body(p))
+			{
+				if (Y == epsilon) continue;
+				if (Y > epsilon)
+				{
+					terms[A].Set(Y);
+					break;
+				}
+				if (Y != A) users[Y].push_back(A);
+				if (!ret[Y].Test(epsilon)) break;
+			}
+		}
+		propagate(terms, users);
+		for (size_t A = (size_t)first; A < (size_t)epsilon; ++A) ret[A].Merge(terms[A]);
+		return ret;
+	}
+
 	template<typename T>
 	typename PushDownAutomaton<T>::FollowTable PushDownAutomaton<T>::FOLLOW(
 		const FirstTable& first_table,
-		const ProductionTable& production_table,
+		const Grammar& grammar,
 		const T epsilon, const T end_symbol, const T first_nonterm)
 	{
-		auto int_first_of_nonterm = (int)first_nonterm;
-		auto int_end_of_nonterm = (int)epsilon - 1;
-		FollowTable ret(int_end_of_nonterm + 1);
-		ret[int_first_of_nonterm].insert(end_symbol);
-		bool changed = true;
-		while (changed)
+		auto symbol_count = (size_t)end_symbol + 1;
+		FollowTable ret((size_t)epsilon, BitSet(symbol_count));
+		ret[first_nonterm].Set(end_symbol);
+		// for A -> aBb, FIRST(b) - {epsilon} belongs to FOLLOW(B),
+		// and FOLLOW(A) too if b derives epsilon
+		std::vector<std::vector<size_t>> users((size_t)epsilon);
+		for (size_t p = grammar.nonterm_begin[first_nonterm]; p < grammar.ProductionCount(); ++p)
 		{
-			changed = false;
-			//do until Follow_Table no longer changes;
-			for (int non_term = int_first_of_nonterm; non_term <= int_end_of_nonterm; ++non_term)
+			auto A = grammar.heads[p];
+			auto production = grammar.Body(p);
+			BitSet first_of_beta(symbol_count);
+			bool beta_nullable = true;
+			for (size_t pos = production.size(); pos > 0; --pos)
 			{
-				for (int production_index = 0; production_index < production_table[non_term].size(); ++production_index)
+				auto X = production[pos - 1];
+				if (X == epsilon) continue;
+				if (X < epsilon)
 				{
-					for (int pos_B = 0; pos_B < production_table[non_term][production_index].size(); ++pos_B)
-					{
-						//if(ret[0].size()==2)
-						//	__debugbreak();
-						set_follow_of_X_with_certain_beta(
-							changed, first_table, ret, production_table,
-							epsilon, (T)non_term,
-							production_index, pos_B);
-					}
+					ret[X].Merge(first_of_beta);
+					if (beta_nullable && X != A) users[A].push_back(X);
+				}
+				if (!first_table[X].Test(epsilon))
+				{
+					first_of_beta = BitSet(symbol_count);
+					beta_nullable = false;
 				}
+				first_of_beta.Merge(first_table[X]);
+				first_of_beta.Reset(epsilon);
 			}
 		}
+		propagate(ret, users);
 		return ret;
 	}
 
+	template<typename T>
+	void PushDownAutomaton<T>::propagate(
+		std::vector<BitSet>& sets,
+		const std::vector<std::vector<size_t>>& users)
+	{
+		std::vector<size_t> work;
+		std::vector<bool> queued(sets.size(), false);
+		for (size_t x = sets.size(); x > 0; --x)
+			if (x - 1 < users.size() && !users[x - 1].empty())
+			{
+				work.push_back(x - 1);
+				queued[x - 1] = true;
+			}
+		while (!work.empty())
+		{
+			auto x = work.back();
+			work.pop_back();
+			queued[x] = false;
+			for (auto user : users[x])
+				if (sets[user].Merge(sets[x]) && !queued[user] && !users[user].empty())
+				{
+					queued[user] = true;
+					work.push_back(user);
+				}
+		}
+	}
+
 	template<typename T>
 	typename PushDownAutomaton<T>::LL1Table PushDownAutomaton<T>::Preanalysis(
 		const FirstTable& first_table,
 		const FollowTable& follow_table,
-		const ProductionTable& production_table,
+		const Grammar& grammar,
 		const T epsilon, const T end_symbol, const T first_nonterm)
 	{
 		auto int_first_nonterm = (int)first_nonterm;
 		auto int_end_nonterm = (int)epsilon - 1;
 		auto int_epsilon = (int)epsilon;
 		LL1Table ret(int_end_nonterm + 1, std::vector<Production>(end_symbol - epsilon));
-		for (size_t sym = int_first_nonterm; sym < production_table.size(); ++sym)
+		for (size_t sym = int_first_nonterm; sym < grammar.NontermCount(); ++sym)
 		{
 			//A
-			for (const auto& production : production_table[sym])
+			for (size_t production_index = 0; production_index < grammar.ProductionCountOf(sym); ++production_index)
 			{
-				bool has_epsilon = false;
+				auto production = grammar.Body(sym, production_index);
+				bool has_epsilon = true;
 				//A -> a
 				//a -> Y1Y2...Yk
 				//FIRST(a)
-				for (size_t sym_index = 0; sym_index < production.size(); ++sym_index)
+				for (size_t sym_index = 0; sym_index < production.size() && has_epsilon; ++sym_index)
 				{
 					//for every symbol Yj
 					auto Yj = production[sym_index];
-					auto firstset_of_Yj = first_table[Yj];
-					for (auto term : firstset_of_Yj)
-					{
-						has_epsilon = false;
-						if (term == int_epsilon)
+					first_table[Yj].ForEach([&](size_t term)
 						{
-							has_epsilon = true;
-							continue;
-						}
-						auto column = term - epsilon - 1;
-						ret[sym][column] = production;
-					}
+							if (term == int_epsilon) return;
+							auto column = term - epsilon - 1;
+							ret[sym][column] = production.ToVector();
+						});
 					//once a Yj doesn't have int_epsilon , stop.  
-					if (!has_epsilon)
-						break;
+					has_epsilon = first_table[Yj].Test(epsilon);
 				}
 
 				if (has_epsilon)
-					for (auto term : follow_table[sym])
-					{
-						auto column = term - epsilon - 1;
-						ret[sym][column] = production;
-					}
+					follow_table[sym].ForEach([&](size_t term)
+						{
+							auto column = term - epsilon - 1;
+							ret[sym][column] = production.ToVector();
+						});
 			}
 		}
 		return ret;
@@ -561,7 +740,7 @@ namespace MuCplGen
 
 	template<typename T>
 	typename PushDownAutomaton<T>::SimplifiedSetOfItems PushDownAutomaton<T>::CLOSURE(
-		const ProductionTable& production_table,
+		const Grammar& grammar,
 		const std::set<Item> cores,
 		const T& epsilon, const T& start)
 	{
@@ -570,7 +749,7 @@ namespace MuCplGen
 		{
 			// for every core_item
 			const auto& production =
-				production_table[core_item.sym][core_item.production_index];
+				grammar.Body(core_item.sym, core_item.production_index);
 
 			if (core_item.point_pos >= production.size()
 				|| production[core_item.point_pos] >= epsilon)
@@ -586,8 +765,8 @@ namespace MuCplGen
 			changed = false;
 			for (size_t B = 0; B < ret.non_cores.size(); ++B)
 				if (ret.non_cores[B])// if has CLOSURE(B)
-					for (const auto& production : production_table[B])
-						if (production[0] < (int)epsilon
+					for (size_t p = grammar.nonterm_begin[B]; p < grammar.nonterm_begin[B + 1]; ++p)
+						if (auto production = grammar.Body(p); production[0] < (int)epsilon
 							//doesn't contain CLOSURE(C)
 							&& !ret.non_cores[production[0]])
 						{
@@ -599,135 +778,110 @@ namespace MuCplGen
 	}
 
 	template<typename T>
-	void PushDownAutomaton<T>::CLOSURE(
-		std::vector<LR1Item>& I,
-		const ProductionTable& production_table,
+	typename PushDownAutomaton<T>::SuffixFirstTable PushDownAutomaton<T>::SUFFIX_FIRST(
+		const Grammar& grammar,
 		const FirstTable& first_table,
-		const T& epsilon, const T& start)
+		const T& epsilon, const T& end)
 	{
-		bool changed = true;
-		while (changed)
+		auto symbol_count = (size_t)end + 1;
+		SuffixFirstTable ret;
+		ret.firsts.resize(grammar.NontermCount());
+		ret.nullable.resize(grammar.NontermCount());
+		for (size_t A = 0; A < grammar.NontermCount(); ++A)
 		{
-			changed = false;
-			for (size_t i = 0; i < I.size(); ++i)
+			ret.firsts[A].resize(grammar.ProductionCountOf(A));
+			ret.nullable[A].resize(grammar.ProductionCountOf(A));
+			for (size_t production_index = 0; production_index < grammar.ProductionCountOf(A); ++production_index)
 			{
-				auto pro_length = production_table[I[i].nonterm][I[i].production_index].size();
-
-				if (I[i].point_pos >= pro_length) continue;
-
-				auto B = production_table[I[i].nonterm][I[i].production_index][I[i].point_pos];
-				if (B < epsilon)
+				const auto& production = grammar.Body(A, production_index);
+				auto& firsts = ret.firsts[A][production_index];
+				auto& nullable = ret.nullable[A][production_index];
+				firsts.assign(production.size() + 1, BitSet(symbol_count));
+				nullable.assign(production.size() + 1, true);
+				// from the back: FIRST(X beta) = FIRST(X) + FIRST(beta) if X derives epsilon
+				for (size_t pos = production.size(); pos > 0; --pos)
 				{
-					for (size_t B_pro_index = 0; B_pro_index < production_table[B].size(); ++B_pro_index)
+					auto X = production[pos - 1];
+					if (X > epsilon)
 					{
-						if (I[i].point_pos + 1 >= pro_length)
-						{
-							auto contain = false;
-							LR1Item newitem = { B,B_pro_index,0,I[i].LAterm };
-							//for(size_t j = i;j<I.size();++j)
-							for (const auto& containedItem : I)
-								if (containedItem == newitem)
-								{
-									contain = true;
-									break;
-								}
-							if (!contain)
-							{
-								I.push_back(std::move(newitem));
-								changed = true;
-							}
-						}
-						else
-						{
-							for (size_t iter = I[i].point_pos + 1;
-								iter < production_table[I[i].nonterm][I[i].production_index].size();
-								++iter)
-							{
-								const auto& sym = production_table[I[i].nonterm][I[i].production_index][iter];
-								if (sym > epsilon) //if sym is term
-								{
-									const auto& term = sym;
-									auto contain = false;
-									LR1Item newitem = { B,B_pro_index,0, term };
-									for (const auto& containedItem : I)
-										if (containedItem == newitem)
-										{
-											contain = true;
-											break;
-										}
-									if (!contain)
-									{
-										I.push_back(std::move(newitem));
-										changed = true;
-									}
-									break;
-								}
-								else // sym is nonterm
-								{
-									const auto& firsts = first_table[sym];
-									bool has_epsilon = false;
-									for (const auto& first : firsts)
-									{
-										if (first == epsilon) has_epsilon = true;
-										else
-										{
-											auto contain = false;
-											LR1Item newitem = { B,B_pro_index,0,first };
-											for (const auto& containedItem : I)
-												if (containedItem == newitem)
-												{
-													contain = true;
-													break;
-												}
-											if (!contain)
-											{
-												I.push_back(std::move(newitem));
-												changed = true;
-											}
-										}
-									}
-
-									if (has_epsilon)
-									{
-										auto contain = false;
-										LR1Item newitem = { B,B_pro_index,0,I[i].LAterm };
-										for (const auto& containedItem : I)
-											if (containedItem == newitem)
-											{
-												contain = true;
-												break;
-											}
-										if (!contain)
-										{
-											I.push_back(std::move(newitem));
-											changed = true;
-										}
-									}
-
-								}
-							}
-						}
-
+						firsts[pos - 1].Set(X);
+						nullable[pos - 1] = false;
+						continue;
 					}
-				}
-				for (size_t nonterm = 0; nonterm < production_table.size(); ++nonterm)
-					for (size_t pro_index = 0; pro_index < production_table[nonterm].size(); ++pro_index)
+					bool has_epsilon = X == epsilon;
+					if (X < epsilon)
 					{
-						auto pro_length = production_table[nonterm][pro_index].size();
-						if (I[i].point_pos >= pro_length)
-							continue;
-						if (B < epsilon)
-						{
-
-						}
+						firsts[pos - 1].Merge(first_table[X]);
+						firsts[pos - 1].Reset(epsilon);
+						has_epsilon = first_table[X].Test(epsilon);
+					}
+					if (has_epsilon)
+					{
+						firsts[pos - 1].Merge(firsts[pos]);
+						nullable[pos - 1] = nullable[pos];
 					}
+					else nullable[pos - 1] = false;
+				}
+			}
+		}
+		return ret;
+	}
+
+	template<typename T>
+	void PushDownAutomaton<T>::CLOSURE(
+		LR1ItemSet& I,
+		const Grammar& grammar,
+		const SuffixFirstTable& suffix_first_table,
+		const T& epsilon)
+	{
+		const auto none = (size_t)-1;
+		// B's closure items are added together, B -> .gamma is at first_item[B] + production_index
+		std::vector<size_t> first_item((size_t)epsilon, none);
+		std::vector<size_t> work(I.items.size());
+		std::vector<bool> queued(I.items.size(), true);
+		for (size_t i = 0; i < work.size(); ++i) work[i] = work.size() - 1 - i;
+		while (!work.empty())
+		{
+			auto i = work.back();
+			work.pop_back();
+			queued[i] = false;
+			// A -> alpha .B beta
+			auto item = I.items[i];
+			const auto& production = grammar.Body(item.sym, item.production_index);
+			if (item.point_pos >= (int)production.size()) continue;
+			auto B = production[item.point_pos];
+			if (B >= epsilon) continue;
+			// LAterms of B -> .gamma: FIRST(beta a) for every LAterm a
+			auto lookahead = suffix_first_table.firsts[item.sym][item.production_index][item.point_pos + 1];
+			if (suffix_first_table.nullable[item.sym][item.production_index][item.point_pos + 1])
+				lookahead.Merge(I.lookaheads[i]);
+			if (first_item[B] == none)
+			{
+				first_item[B] = I.items.size();
+				for (int production_index = 0; production_index < (int)grammar.ProductionCountOf(B); ++production_index)
+				{
+					I.items.push_back({ B, production_index, 0 });
+					I.lookaheads.push_back(BitSet(lookahead.Size()));
+					// new items close at least once
+					queued.push_back(true);
+					work.push_back(I.items.size() - 1);
+				}
+			}
+			for (size_t production_index = 0; production_index < grammar.ProductionCountOf(B); ++production_index)
+			{
+				auto j = first_item[B] + production_index;
+				if (I.lookaheads[j].Merge(lookahead) && !queued[j])
+				{
+					queued[j] = true;
+					work.push_back(j);
+				}
 			}
 		}
 	}
 
 	template<typename T>
 	typename PushDownAutomaton<T>::SimplifiedSetOfItems PushDownAutomaton<T>::GOTO(
-		const ProductionTable& production_table,
+		const Grammar& grammar,
 		const SimplifiedSetOfItems& I,
 		const T& symbol, const T& epsilon, const T& start)
 	{
@@ -737,7 +891,7 @@ namespace MuCplGen
 		{
 			// for every core_item
 			const auto& production =
-				production_table[core_item.sym][core_item.production_index];
+				grammar.Body(core_item.sym, core_item.production_index);
 			if (core_item.point_pos < production.size()
 				// e.g. E->E.+T symbol = +
 				&& production[core_item.point_pos] == symbol
@@ -754,110 +908,157 @@ namespace MuCplGen
 		{
 			if (I.non_cores[sym])// if has CLOSURE(nonterm)
 				for (int production_index = 0;
-					production_index < production_table[sym].size();
+					production_index < grammar.ProductionCountOf(sym);
 					++production_index)
 					if (
-						production_table[sym][production_index][0] == symbol)
+						grammar.Body(sym, production_index)[0] == symbol)
 					{
 						// e.g.  insert E->T.
 						// insert Item(initialized by list)
 						cores.insert({ (T)sym,production_index,1 });
 					}
 		}
-		SimplifiedSetOfItems ret = CLOSURE(production_table, cores, epsilon, start);
+		SimplifiedSetOfItems ret = CLOSURE(grammar, cores, epsilon, start);
 		return ret;
 	}
 
-	template<typename T>
-	std::vector<typename PushDownAutomaton<T>::LR1Item> PushDownAutomaton<T>::GOTO(const ProductionTable& production_table, const FirstTable& first_table, const std::vector<LR1Item>& I, const T& symbol, const T& epsilon, const T& start)
-	{
-		std::vector<LR1Item> J;
-		// for every item
-		for (const auto& item : I)
-		{
-			const auto& production =
-				production_table[item.nonterm][item.production_index];
-			if (item.point_pos < production.size()
-				// e.g. E->E.+T
-				&& production[item.point_pos] == symbol)
-			{
-				J.push_back({ item.nonterm ,item.production_index,item.point_pos + 1,item.LAterm });
-			}
-		}
-		CLOSURE(J, production_table, first_table, epsilon, start);
-		return J;
-	}
-
 	template<typename T>
 	std::tuple<typename PushDownAutomaton<T>::LR1Collection, typename PushDownAutomaton<T>::GotoTable>
 		PushDownAutomaton<T>::COLLECTION_LR(
-			const ProductionTable& production_table,
+			const Grammar& grammar,
 			const FirstTable& first_table,
-			const T& epsilon, const T& end, const T& start)
+			const T& epsilon, const T& end, const T& start,
+			ThreadPool& pool)
 	{
 		std::tuple<LR1Collection, GotoTable> ret;
 		auto& collection = std::get<0>(ret);
 		auto& table = std::get<1>(ret);
-		std::vector<LR1Item> I0 = { {start,0,0,end} };
-		CLOSURE(I0, production_table, first_table, epsilon, start);
-		collection.push_back(I0);
-
-		bool changed = true;
-		size_t iter = 0;
-		size_t start_pos = 0;
-		while (changed)
+		auto suffix_first_table = SUFFIX_FIRST(grammar, first_table, epsilon, end);
+
+		// [S' -> .S, $]
+		LR1ItemSet I0;
+		I0.items.push_back({ start, 0, 0 });
+		I0.lookaheads.push_back(BitSet((size_t)end + 1));
+		I0.lookaheads.back().Set(end);
+		I0.kernel_size = 1;
+		CLOSURE(I0, grammar, suffix_first_table, epsilon);
+		collection.push_back(std::move(I0));
+
+		// hash of kernel -> states
+		std::unordered_map<size_t, std::vector<size_t>> kernel_index;
+		kernel_index[kernel_hash(collection[0])].push_back(0);
+		for (size_t wave_begin = 0; wave_begin < collection.size();)
 		{
-			// in order to record where to start in next loop 
-			iter = collection.size();
-			changed = false;
-			for (size_t i = start_pos; i < collection.size(); ++i)
-				for (int Sym = 0; Sym <= (int)end; ++Sym)
+			auto wave_end = collection.size();
+			std::vector<std::vector<std::pair<T, LR1ItemSet>>> kernels(wave_end - wave_begin);
+			std::vector<std::vector<size_t>> hashes(wave_end - wave_begin);
+			pool.ParallelFor(wave_end - wave_begin, [&](size_t k)
+				{
+					kernels[k] = goto_kernels(grammar, collection[wave_begin + k]);
+					for (const auto& [X, kernel] : kernels[k]) hashes[k].push_back(kernel_hash(kernel));
+				});
+			// number the new states, their closures are left to the next step
+			for (size_t k = 0; k < kernels.size(); ++k)
+				for (size_t g = 0; g < kernels[k].size(); ++g)
 				{
-					// for every symbol X
-					std::vector<LR1Item> temp_I =
-						GOTO(production_table, first_table, collection[i], (T)Sym, epsilon, start);
-					bool inexist = true;
-					if (temp_I.size())
-						for (int j = 0; j < collection.size(); ++j)
+					auto& [X, kernel] = kernels[k][g];
+					auto& states = kernel_index[hashes[k][g]];
+					auto aim_state = collection.size();
+					for (auto j : states)
+						if (same_kernel(collection[j], kernel))
 						{
-							if (temp_I == collection[j])
-							{
-								inexist = false;
-								// GOTO[state_i,symbol] -> state_j
-								table[{i, (T)Sym}] = j;
-								break;
-							}
+							aim_state = j;
+							break;
 						}
-					else
-					{
-						continue;
-					}
-
-					if (inexist)
+					if (aim_state == collection.size())
 					{
-						// generate a new state which is now the last elem of collection
-						table[{i, (T)Sym}] = collection.size();
-						collection.push_back(temp_I);
-						changed = true;
+						states.push_back(aim_state);
+						collection.push_back(std::move(kernel));
 					}
+					// GOTO[state_i,symbol] -> state_j
+					table[{ wave_begin + k, X }] = aim_state;
 				}
-			start_pos = iter;
+			pool.ParallelFor(collection.size() - wave_end, [&](size_t k)
+				{
+					CLOSURE(collection[wave_end + k], grammar, suffix_first_table, epsilon);
+				});
+			wave_begin = wave_end;
 		}
 		return ret;
 	}
 
+	template<typename T>
+	std::vector<std::pair<T, typename PushDownAutomaton<T>::LR1ItemSet>> PushDownAutomaton<T>::goto_kernels(
+		const Grammar& grammar,
+		const LR1ItemSet& I)
+	{
+		std::map<T, LR1ItemSet> kernels;
+		for (size_t k = 0; k < I.items.size(); ++k)
+		{
+			const auto& item = I.items[k];
+			const auto& production = grammar.Body(item.sym, item.production_index);
+			if (item.point_pos >= (int)production.size()) continue;
+			auto& J = kernels[production[item.point_pos]];
+			J.items.push_back({ item.sym, item.production_index, item.point_pos + 1 });
+			J.lookaheads.push_back(I.lookaheads[k]);
+		}
+		std::vector<std::pair<T, LR1ItemSet>> ret;
+		for (auto& [X, J] : kernels)
+		{
+			std::vector<size_t> order(J.items.size());
+			for (size_t k = 0; k < order.size(); ++k) order[k] = k;
+			std::sort(order.begin(), order.end(),
+				[&J](size_t lhs, size_t rhs) { return J.items[lhs] < J.items[rhs]; });
+			LR1ItemSet kernel;
+			for (auto k : order)
+			{
+				kernel.items.push_back(J.items[k]);
+				kernel.lookaheads.push_back(std::move(J.lookaheads[k]));
+			}
+			kernel.kernel_size = kernel.items.size();
+			ret.push_back({ X, std::move(kernel) });
+		}
+		return ret;
+	}
+
+	template<typename T>
+	size_t PushDownAutomaton<T>::kernel_hash(const LR1ItemSet& I)
+	{
+		size_t h = I.kernel_size;
+		for (size_t k = 0; k < I.kernel_size; ++k)
+		{
+			const auto& item = I.items[k];
+			h = h * 31 + (size_t)item.sym;
+			h = h * 31 + (size_t)item.production_index;
+			h = h * 31 + (size_t)item.point_pos;
+			h = h * 31 + I.lookaheads[k].Hash();
+		}
+		return h;
+	}
+
+	template<typename T>
+	bool PushDownAutomaton<T>::same_kernel(const LR1ItemSet& lhs, const LR1ItemSet& rhs)
+	{
+		if (lhs.kernel_size != rhs.kernel_size) return false;
+		for (size_t k = 0; k < lhs.kernel_size; ++k)
+			if (!(lhs.items[k] == rhs.items[k]) || lhs.lookaheads[k] != rhs.lookaheads[k])
+				return false;
+		return true;
+	}
+
 	template<typename T>
 	std::tuple<typename PushDownAutomaton<T>::CollectionOfItemSets, typename PushDownAutomaton<T>::GotoTable>
 		PushDownAutomaton<T>::COLLECTION(
-			const ProductionTable& production_table,
-			const T& epsilon, const T& end, const T& start)
+			const Grammar& grammar,
+			const T& epsilon, const T&, const T& start,
+			ThreadPool& pool)
 	{
 		std::tuple<CollectionOfItemSets, GotoTable> ret;
 		CollectionOfItemSets& collection = std::get<0>(ret);
 		GotoTable& table = std::get<1>(ret);
 
 		SimplifiedSetOfItems I0 = CLOSURE(
-			production_table,
+			grammar,
 			std::set<Item>({ {start,0,0} }),
 			epsilon, start);
 		collection.push_back(I0);
@@ -873,53 +1074,90 @@ namespace MuCplGen
 		// whether this state already exists in all privous
 		// generations. i.e. whether we need to generate a new
 		// Item in the bottom of the Collection. 
-		bool changed = true;
-		size_t iter = 0;
-		size_t start_pos = 0;
-		while (changed)
+		// a generation is a wave: its GOTOs run on pool, then the new states are numbered in order
+
+		// hash of cores -> states
+		std::unordered_map<size_t, std::vector<size_t>> core_index;
+		core_index[cores_hash(collection[0].cores)].push_back(0);
+		for (size_t wave_begin = 0; wave_begin < collection.size();)
 		{
-			// in order to record where to start in next loop 
-			iter = collection.size();
-			changed = false;
-			for (size_t i = start_pos; i < collection.size(); ++i)
-				for (size_t Sym = 0; Sym <= (size_t)end; ++Sym)
+			auto wave_end = collection.size();
+			std::vector<std::vector<std::pair<T, SimplifiedSetOfItems>>> gotos(wave_end - wave_begin);
+			std::vector<std::vector<size_t>> hashes(wave_end - wave_begin);
+			pool.ParallelFor(wave_end - wave_begin, [&](size_t k)
 				{
-					// for every symbol X
-					SimplifiedSetOfItems temp_I =
-						GOTO(production_table, collection[i], (T)Sym, epsilon, start);
-					bool inexist = true;
-					if (temp_I.cores.size())
-						for (int j = 0; j < collection.size(); ++j)
-						{
-							if (temp_I == collection[j])
-							{
-								inexist = false;
-								// GOTO[state_i,symbol] -> state_j
-								table[{i, (T)Sym}] = j;
-								break;
-							}
-						}
-					else
+					const auto& I = collection[wave_begin + k];
+					for (auto Sym : goto_symbols(grammar, I))
 					{
-						continue;
+						// for every symbol X
+						SimplifiedSetOfItems temp_I = GOTO(grammar, I, Sym, epsilon, start);
+						if (!temp_I.cores.size()) continue;
+						hashes[k].push_back(cores_hash(temp_I.cores));
+						gotos[k].push_back({ Sym, std::move(temp_I) });
 					}
-
-					if (inexist)
+				});
+			for (size_t k = 0; k < gotos.size(); ++k)
+				for (size_t g = 0; g < gotos[k].size(); ++g)
+				{
+					auto& [Sym, temp_I] = gotos[k][g];
+					auto& states = core_index[hashes[k][g]];
+					auto aim_state = collection.size();
+					for (auto j : states)
+						if (temp_I == collection[j])
+						{
+							aim_state = j;
+							break;
+						}
+					if (aim_state == collection.size())
 					{
 						// generate a new state which is now the last elem of collection
-						table[{i, (T)Sym}] = collection.size();
-						collection.push_back(temp_I);
-						changed = true;
+						states.push_back(aim_state);
+						collection.push_back(std::move(temp_I));
 					}
+					// GOTO[state_i,symbol] -> state_j
+					table[{ wave_begin + k, Sym }] = aim_state;
 				}
-			start_pos = iter;
+			wave_begin = wave_end;
+		}
+		return ret;
+	}
+
+	template<typename T>
+	std::vector<T> PushDownAutomaton<T>::goto_symbols(
+		const Grammar& grammar,
+		const SimplifiedSetOfItems& I)
+	{
+		std::vector<T> ret;
+		for (const auto& core_item : I.cores)
+		{
+			auto production = grammar.Body(core_item.sym, core_item.production_index);
+			if (core_item.point_pos < (int)production.size()) ret.push_back(production[core_item.point_pos]);
 		}
+		for (size_t B = 0; B < I.non_cores.size(); ++B)
+			if (I.non_cores[B])
+				for (size_t p = grammar.nonterm_begin[B]; p < grammar.nonterm_begin[B + 1]; ++p)
+					ret.push_back(grammar.Body(p)[0]);
+		std::sort(ret.begin(), ret.end());
+		ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
 		return ret;
 	}
 
+	template<typename T>
+	size_t PushDownAutomaton<T>::cores_hash(const std::set<Item>& cores)
+	{
+		size_t h = cores.size();
+		for (const auto& item : cores)
+		{
+			h = h * 31 + (size_t)item.sym;
+			h = h * 31 + (size_t)item.production_index;
+			h = h * 31 + (size_t)item.point_pos;
+		}
+		return h;
+	}
+
 	template<typename T>
 	typename PushDownAutomaton<T>::ActionTable PushDownAutomaton<T>::SetActionTable(
-		const ProductionTable& production_table,
+		const Grammar& grammar,
 		const LR1Collection& collection,
 		const GotoTable& goto_table,
 		const FollowTable& follow_table,
@@ -960,73 +1198,78 @@ namespace MuCplGen
 			}
 			else if (int_sym == int_epsilon)
 			{
-				for (const auto& item : collection[cur_state])
-					if (production_table[item.nonterm][item.production_index][0] == epsilon)
-					{
-						Action a;
-						a.type = ActionType::move_epsilon;
-						// also record the next state to be moved into the stack
-						a.aim_state = aim_state;
-						a.sym = epsilon;
-						a.production_length = 0;
-						auto iter = ret.find({ cur_state, item.LAterm });
-						if (iter != ret.end())
-							if (a.type != iter->second.type
-								|| a.sym != iter->second.sym
-								|| a.production_index != iter->second.production_index)
-							{
-								PDABuildConflict conflict("Conflict");
-								conflict.head = item.nonterm;
-								conflict.production_index = item.production_index;
-								conflict.sym = a.sym;
-								conflict.follow = item.LAterm;
-								throw conflict;
-							}
-						ret[{cur_state, item.LAterm}] = std::move(a);
-					}
+				const auto& I = collection[cur_state];
+				for (size_t k = 0; k < I.items.size(); ++k)
+				{
+					const auto& item = I.items[k];
+					if (grammar.Body(item.sym, item.production_index)[0] != epsilon) continue;
+					I.lookaheads[k].ForEach([&](size_t LAterm)
+						{
+							Action a;
+							a.type = ActionType::move_epsilon;
+							// also record the next state to be moved into the stack
+							a.aim_state = aim_state;
+							a.sym = epsilon;
+							a.production_length = 0;
+							auto iter = ret.find({ cur_state, (T)LAterm });
+							if (iter != ret.end())
+								if (a.type != iter->second.type
+									|| a.sym != iter->second.sym
+									|| a.production_index != iter->second.production_index)
+								{
+									PDABuildConflict conflict("Conflict");
+									conflict.head = item.sym;
+									conflict.production_index = item.production_index;
+									conflict.sym = a.sym;
+									conflict.follow = LAterm;
+									throw conflict;
+								}
+							ret[{cur_state, (T)LAterm}] = std::move(a);
+						});
+				}
 			}
 		}
 		//for every certain Ii
 		for (size_t i = 0; i < collection.size(); ++i)
 		{
 			//for every certain item in Ii
-			for (const auto& item : collection[i])
+			for (size_t k = 0; k < collection[i].items.size(); ++k)
 			{
-				auto production_length = production_table[item.nonterm][item.production_index].size();
-				if (item.point_pos >= production_length)
+				const auto& item = collection[i].items[k];
+				auto production_length = grammar.Body(item.sym, item.production_index).size();
+				if (item.point_pos < (int)production_length) continue;
+				if (item.sym == start)
+					// if S'-> S.
 				{
-					if (item.nonterm == start)
-						// if S'-> S.
-					{
-						// then ACTION[i,$] = accept
-						Action a;
-						a.type = ActionType::accept;
-						a.aim_state = 0;
-						a.sym = start;
-						a.production_index = item.production_index;
-						a.production_length = production_length;
-						ret[{i, end}] = std::move(a);
-					}
-					else
+					// then ACTION[i,$] = accept
+					Action a;
+					a.type = ActionType::accept;
+					a.aim_state = 0;
+					a.sym = start;
+					a.production_index = item.production_index;
+					a.production_length = production_length;
+					ret[{i, end}] = std::move(a);
+					continue;
+				}
+				collection[i].lookaheads[k].ForEach([&](size_t LAterm)
 					{
 						Action a;
 						a.type = ActionType::reduce;
 						// also record the head of the production
-						a.sym = item.nonterm;
+						a.sym = item.sym;
 						a.production_index = item.production_index;
 						a.production_length = production_length;
 
-						if (ret.count({ i, item.LAterm }))
+						if (ret.count({ i, (T)LAterm }))
 						{
 							PDABuildConflict conflict("Conflict");
-							conflict.head = item.nonterm;
+							conflict.head = item.sym;
 							conflict.production_index = item.production_index;
-							conflict.follow = item.LAterm;
+							conflict.follow = LAterm;
 							throw conflict;
 						}
-						ret[{i, item.LAterm}] = std::move(a);
-					}
-				}
+						ret[{i, (T)LAterm}] = std::move(a);
+					});
 			}
 		}
 		return ret;
@@ -1034,7 +1277,7 @@ namespace MuCplGen
 
 	template<typename T>
 	typename PushDownAutomaton<T>::ActionTable PushDownAutomaton<T>::SetActionTable(
-		const ProductionTable& production_table,
+		const Grammar& grammar,
 		const CollectionOfItemSets& collection,
 		const GotoTable& goto_table,
 		const FollowTable& follow_table,
@@ -1077,11 +1320,10 @@ namespace MuCplGen
 				for (size_t i = 0; i < collection[cur_state].non_cores.size(); ++i)
 					if (collection[cur_state].non_cores[i])
 					{
-						size_t production_index = 0;
-						for (const auto& pro : production_table[i])
+						for (size_t production_index = 0; production_index < grammar.ProductionCountOf(i); ++production_index)
 						{
-							if (pro[0] == epsilon)
-								for (const auto& term : follow_table[i])
+							if (grammar.Body(i, production_index)[0] == epsilon)
+								follow_table[i].ForEach([&](size_t term)
 								{
 									Action a;
 									a.type = ActionType::move_epsilon;
@@ -1089,7 +1331,7 @@ namespace MuCplGen
 									a.aim_state = aim_state;
 									a.sym = (T)int_sym;
 									a.production_length = 0;
-									auto iter = ret.find({ cur_state, term });
+									auto iter = ret.find({ cur_state, (T)term });
 									if (iter != ret.end())
 										if (a.type != iter->second.type
 											|| a.sym != iter->second.sym
@@ -1103,9 +1345,8 @@ namespace MuCplGen
 											conflict.follow = term;
 											throw conflict;
 										}
-									ret[{cur_state, term}] = std::move(a);
-								}
-							++production_index;
+									ret[{cur_state, (T)term}] = std::move(a);
+								});
 						}
 					}
 
@@ -1117,7 +1358,7 @@ namespace MuCplGen
 			for (const Item& core : collection[i].cores)
 			{
 				// every certain core
-				auto production_length = production_table[(int)core.sym][core.production_index].size();
+				auto production_length = grammar.Body((int)core.sym, core.production_index).size();
 				if (core.point_pos >= production_length)
 				{
 					if (core.sym == start)
@@ -1133,7 +1374,7 @@ namespace MuCplGen
 						ret[{i, end}] = std::move(a);
 					}
 					else
-						for (const auto& term : follow_table[(int)core.sym])
+						follow_table[(int)core.sym].ForEach([&](size_t term)
 						{
 							// then for every term a, in FOLLOW(A)
 							Action a;
@@ -1142,7 +1383,7 @@ namespace MuCplGen
 							a.sym = core.sym;
 							a.production_index = core.production_index;
 							a.production_length = production_length;
-							if (ret.count({ i, term }))
+							if (ret.count({ i, (T)term }))
 							{
 								PDABuildConflict conflict("Conflict");
 								conflict.head = core.sym;
@@ -1150,8 +1391,8 @@ namespace MuCplGen
 								conflict.follow = term;
 								throw conflict;
 							}
-							ret[{i, term}] = std::move(a);
-						}
+							ret[{i, (T)term}] = std::move(a);
+						});
 				}
 			}
 		}
@@ -1159,124 +1400,242 @@ namespace MuCplGen
 	}
 
 	template<typename T>
-	void PushDownAutomaton<T>::setup_first_table(
-		bool& changed,
-		FirstTable& first_table,
-		const ProductionTable& production_table,
-		const T epsilon, const T Sym)
+	typename PushDownAutomaton<T>::LALRLookaheads PushDownAutomaton<T>::LALR_LOOKAHEADS(
+		const Grammar& grammar,
+		const FirstTable& first_table,
+		const CollectionOfItemSets& collection,
+		const GotoTable& goto_table,
+		const T& epsilon, const T& end, const T& start)
 	{
-		auto int_sym = (int)Sym;
-		auto int_epsilon = (int)epsilon;
-		//for X -> a
-		if (int_sym >= int_epsilon)
+		auto nullable = [&](T sym)
+		{
+			return sym == epsilon || (sym < epsilon && first_table[sym].Test(epsilon));
+		};
+
+		// nonterm transitions (p, A), moving epsilon included
+		std::vector<std::pair<size_t, T>> transitions;
+		std::vector<std::vector<T>> shifts(collection.size());
+		std::vector<std::vector<T>> nullable_gotos(collection.size());
+		for (auto& [key, next] : goto_table)
+		{
+			if (key.second <= epsilon)
+			{
+				transitions.push_back(key);
+				if (nullable(key.second)) nullable_gotos[key.first].push_back(key.second);
+			}
+			else if (key.second < end) shifts[key.first].push_back(key.second);
+		}
+		std::sort(transitions.begin(), transitions.end());
+		std::unordered_map<std::pair<size_t, T>, size_t, GotoHash, GotoEqual> transition_index;
+		for (size_t t = 0; t < transitions.size(); ++t) transition_index[transitions[t]] = t;
+
+		// DR(p, A): the terms read right after A, $ after S' -> S.
+		// reads: (p, A) reads (r, B) if r = GOTO(p, A) and B is nullable
+		std::vector<std::set<T>> follow(transitions.size());
+		std::vector<std::vector<size_t>> reads(transitions.size());
+		for (size_t t = 0; t < transitions.size(); ++t)
 		{
-			if (first_table[Sym].insert(Sym).second)
-				changed = true;
+			auto r = goto_table.at(transitions[t]);
+			follow[t].insert(shifts[r].begin(), shifts[r].end());
+			for (const auto& core : collection[r].cores)
+				if (core.sym == start && core.point_pos >= (int)grammar.Body(start, core.production_index).size())
+					follow[t].insert(end);
+			for (auto B : nullable_gotos[r]) reads[t].push_back(transition_index[{ r, B }]);
 		}
-		else
+		digraph(reads, follow);
+
+		// includes: (p, B) includes (p', A) if A -> beta B gamma, gamma is nullable and p' reaches p through beta
+		// lookback: the reduce of A -> omega in q looks back to (p', A) if p' reaches q through omega
+		std::vector<std::vector<size_t>> includes(transitions.size());
+		std::vector<std::tuple<size_t, T, int, size_t>> lookbacks;
+		for (size_t t = 0; t < transitions.size(); ++t)
 		{
-			//productions of X:
-			//X -> alpha | beta | ...
-			for (size_t production_index = 0; production_index < production_table[int_sym].size(); ++production_index)
+			auto [from, A] = transitions[t];
+			if (A >= epsilon) continue;
+			for (int production_index = 0; production_index < (int)grammar.ProductionCountOf(A); ++production_index)
 			{
-				// a certain production: X -> Y1Y2...Yk
-				if (production_table[int_sym][production_index][0] != int_epsilon)
-					//if the production is not X -> epsilon
+				const auto& production = grammar.Body(A, production_index);
+				std::vector<bool> nullable_after(production.size() + 1, true);
+				for (size_t i = production.size(); i > 0; --i)
+					nullable_after[i - 1] = nullable_after[i] && nullable(production[i - 1]);
+				auto state = from;
+				bool reached = true;
+				for (size_t i = 0; i < production.size(); ++i)
 				{
-					bool has_epsilon = false;
-					for (size_t nonterm_index = 0; nonterm_index < production_table[int_sym][production_index].size(); ++nonterm_index)
+					auto X = production[i];
+					if (X <= epsilon && nullable_after[i + 1])
 					{
-						//for every symbol Yj
-						auto Yj = production_table[int_sym][production_index][nonterm_index];
-						auto firstset_of_Yj = first_table[Yj];
-						for (auto term : firstset_of_Yj)
-						{
-							has_epsilon = false;
-							if (term == int_epsilon)
-							{
-								has_epsilon = true;
-								continue;
-							}
-							if (first_table[int_sym].insert(term).second) changed = true;
-						}
-						//once a Yj doesn't have int_epsilon , stop.  
-						if (!has_epsilon)
-							break;
+						auto iter = transition_index.find({ state, X });
+						if (iter != transition_index.end()) includes[iter->second].push_back(t);
+					}
+					auto next = goto_table.find({ state, X });
+					if (next == goto_table.end())
+					{
+						reached = false;
+						break;
 					}
-					//if all Yj has int_epsilon , then put int_epsilon into FIRST(X);
-					if (has_epsilon && first_table[int_sym].insert(epsilon).second)
-						changed = true;
+					state = next->second;
 				}
-				//when the production is X -> epsilon
-				else if (first_table[int_sym].insert(epsilon).second)
-					changed = true;
+				if (reached) lookbacks.push_back({ state, A, production_index, t });
 			}
 		}
+		digraph(includes, follow);
+
+		LALRLookaheads ret;
+		ret.reduce.resize(collection.size());
+		ret.move_epsilon.resize(collection.size());
+		for (auto& [state, A, production_index, t] : lookbacks)
+		{
+			auto& terms = ret.reduce[state][{ A, production_index }];
+			terms.insert(follow[t].begin(), follow[t].end());
+		}
+		for (size_t t = 0; t < transitions.size(); ++t)
+			if (transitions[t].second == epsilon)
+				ret.move_epsilon[transitions[t].first] = follow[t];
+		return ret;
 	}
 
 	template<typename T>
-	void PushDownAutomaton<T>::set_follow_of_X_with_certain_beta(
-		bool& changed,
-		const FirstTable& first_table,
-		FollowTable& follow_table,
-		const ProductionTable& production_table,
-		const T epsilon, const T sym_A,
-		const int production_index, const int pos_B)
+	void PushDownAutomaton<T>::digraph(
+		const std::vector<std::vector<size_t>>& edges,
+		std::vector<std::set<T>>& F)
 	{
-		auto int_sym_A = (int)sym_A;
-		auto int_sym_B = (int)production_table[int_sym_A][production_index][pos_B];
-		const size_t beta_start_index = pos_B + 1;
-		// if(int_sym_A == 1 && beta_start_index == 2)
-		//	__debugbreak();
-
-		// if B is not non-term 
-		if (int_sym_B >= (int)epsilon)
-			return;
+		std::vector<size_t> depth(edges.size(), 0);
+		std::vector<size_t> stack;
+		for (size_t x = 0; x < edges.size(); ++x)
+			if (depth[x] == 0) digraph_traverse(x, edges, F, depth, stack);
+	}
 
-		if (beta_start_index >= production_table[int_sym_A][production_index].size())
+	template<typename T>
+	void PushDownAutomaton<T>::digraph_traverse(
+		size_t x,
+		const std::vector<std::vector<size_t>>& edges,
+		std::vector<std::set<T>>& F,
+		std::vector<size_t>& depth,
+		std::vector<size_t>& stack)
+	{
+		// depth: 0 not visited, -1 done
+		const auto done = (size_t)-1;
+		stack.push_back(x);
+		auto d = stack.size();
+		depth[x] = d;
+		for (auto y : edges[x])
+		{
+			if (depth[y] == 0) digraph_traverse(y, edges, F, depth, stack);
+			depth[x] = (std::min)(depth[x], depth[y]);
+			if (y != x) F[x].insert(F[y].begin(), F[y].end());
+		}
+		if (depth[x] == d)
 		{
-			// then all FOLLOW(A) belongs to FOLLOW(B)
-			const auto& follow_of_A = follow_table[int_sym_A];
-			for (auto term : follow_of_A)
+			while (true)
 			{
-				if (follow_table[int_sym_B].insert(term).second)
-					changed = true;
+				auto top = stack.back();
+				stack.pop_back();
+				depth[top] = done;
+				if (top == x) break;
+				F[top] = F[x];
 			}
-			return;
 		}
+	}
 
-		bool has_epsilon = false;
-		const size_t length_of_production = production_table[int_sym_A][production_index].size();
-
-		for (size_t index_in_beta = beta_start_index; index_in_beta < length_of_production; ++index_in_beta)
+	template<typename T>
+	typename PushDownAutomaton<T>::ActionTable PushDownAutomaton<T>::SetActionTable(
+		const Grammar& grammar,
+		const CollectionOfItemSets& collection,
+		const GotoTable& goto_table,
+		const LALRLookaheads& lookaheads,
+		const T& epsilon, const T& end, const T& start)
+	{
+		ActionTable ret;
+		for (const auto& [key, aim_state] : goto_table)
 		{
-			// for certain Xi
-			T sym_X = production_table[int_sym_A][production_index][index_in_beta];
-			int int_sym_X = (int)sym_X;
-			for (auto term : first_table[int_sym_X])
+			auto [cur_state, Sym] = key;
+			if (Sym > epsilon && Sym < end)
 			{
-				if (term == epsilon)
+				// ACTION[i,a] = move in a
+				Action a;
+				a.type = ActionType::move_in;
+				a.aim_state = aim_state;
+				a.sym = Sym;
+				a.production_length = 0;
+				auto iter = ret.find({ cur_state, Sym });
+				if (iter != ret.end() && (a.type != iter->second.type || a.sym != iter->second.sym))
 				{
-					has_epsilon = true;
-					continue;
+					PDABuildConflict conflict("Conflict");
+					conflict.sym_production_index = a.production_index;
+					conflict.sym = a.sym;
+					throw conflict;
+				}
+				ret[{ cur_state, Sym }] = std::move(a);
+			}
+			else if (Sym == epsilon)
+			{
+				for (const auto& term : lookaheads.move_epsilon[cur_state])
+				{
+					Action a;
+					a.type = ActionType::move_epsilon;
+					a.aim_state = aim_state;
+					a.sym = epsilon;
+					a.production_length = 0;
+					auto iter = ret.find({ cur_state, term });
+					if (iter != ret.end() && (a.type != iter->second.type || a.sym != iter->second.sym))
+					{
+						PDABuildConflict conflict("Conflict");
+						// the first nonterm moving epsilon here
+						for (const auto& core : collection[aim_state].cores)
+						{
+							conflict.head = core.sym;
+							conflict.production_index = core.production_index;
+							break;
+						}
+						conflict.sym = a.sym;
+						conflict.follow = term;
+						throw conflict;
+					}
+					ret[{ cur_state, term }] = std::move(a);
 				}
-				if (follow_table[int_sym_B].insert(term).second)
-					changed = true;
 			}
-			if (!has_epsilon)
-				break;
 		}
-
-		// then all FOLLOW(A) belongs to FOLLOW(B)
-		if (has_epsilon)
+		for (size_t i = 0; i < collection.size(); ++i)
 		{
-			const auto& follow_of_A = follow_table[int_sym_A];
-			for (auto term : follow_of_A)
+			for (const Item& core : collection[i].cores)
 			{
-				if (follow_table[int_sym_B].insert(term).second)
-					changed = true;
+				auto production_length = grammar.Body(core.sym, core.production_index).size();
+				if (core.point_pos < production_length) continue;
+				if (core.sym == start)
+				{
+					// S'-> S. : ACTION[i,$] = accept
+					Action a;
+					a.type = ActionType::accept;
+					a.aim_state = 0;
+					a.sym = start;
+					a.production_index = core.production_index;
+					a.production_length = production_length;
+					ret[{ i, end }] = std::move(a);
+					continue;
+				}
+				auto terms = lookaheads.reduce[i].find({ core.sym, core.production_index });
+				if (terms == lookaheads.reduce[i].end()) continue;
+				for (const auto& term : terms->second)
+				{
+					Action a;
+					a.type = ActionType::reduce;
+					a.sym = core.sym;
+					a.production_index = core.production_index;
+					a.production_length = production_length;
+					if (ret.count({ i, term }))
+					{
+						PDABuildConflict conflict("Conflict");
+						conflict.head = core.sym;
+						conflict.production_index = core.production_index;
+						conflict.follow = term;
+						throw conflict;
+					}
+					ret[{ i, term }] = std::move(a);
+				}
 			}
 		}
+		return ret;
 	}
 
 	template<typename T>
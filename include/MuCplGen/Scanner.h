@@ -1,9 +1,22 @@
 ﻿#pragma once
 #include <regex>
+#include <vector>
 #include <functional>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <algorithm>
+#include <iterator>
+#include <exception>
+#include <cstdint>
 #include "LineContent.h"
+#include "InputSource.h"
 #include "Token.h"
 #include "MuException.h"
+#include "FiniteAutomaton.h"
+#include "ThreadPool.h"
+#include "TokenStream.h"
+#include "DebugTool/ColoredText.h"
 namespace MuCplGen
 {
 	enum ScannActionResult
@@ -13,6 +26,27 @@ namespace MuCplGen
 		DiscardThisToken = 1 << 1,
 	};
 
+	enum class ScannEngine
+	{
+		// every rule runs its own std::regex_search, the longest match wins
+		Regex = 0,
+		// all rules are compiled into one minimized DFA, one pass over the bytes per token
+		DFA = 1
+	};
+
+	// regex of a ScannRule
+	// the source pattern is kept, so that the rule can be compiled into the DFA of ScannEngine::DFA
+	struct ScannExpression
+	{
+		ScannExpression() = default;
+		ScannExpression(const char* pattern) : pattern(pattern), regex(pattern) {}
+		ScannExpression(const std::string& pattern) : pattern(pattern), regex(pattern) {}
+		// a prebuilt std::regex has no pattern, works with ScannEngine::Regex only
+		ScannExpression(const std::regex& regex) : regex(regex) {}
+		std::string pattern;
+		std::regex regex;
+	};
+
 	struct CommonRegex
 	{
 		static constexpr const char* Blank = "^( |\n|\t)+";
@@ -20,6 +54,17 @@ namespace MuCplGen
 		static constexpr const char* Identifier = R"(^([a-z]|[A-Z]|_)\w*)";
 		static constexpr const char* RawString = R"(^((".*?[^\\]")|('(\\.|.)')))";
 	};
+	// tokens together with the text they are scanned from
+	// names of view tokens (ViewToken) refer into source, keep the result alive while using them
+	template<class Token>
+	struct ScannResult
+	{
+		std::shared_ptr<const InputSource> source;
+		std::vector<Token> tokens;
+		// color of every token, only kept by ScannCompact for Highlight
+		std::vector<Debug::ConsoleForegroundColor> colors;
+	};
+
 	template<class Token = BaseToken>
 	struct Scanner
 	{
@@ -30,93 +75,446 @@ namespace MuCplGen
 		{
 			int priority = 0;
 			std::string tokenType;
-			std::regex expression;
+			ScannExpression expression;
 			ScannAction onSucceed;
+			// the match may run over line ends (e.g. block comments), only for ScannSource
+			// such a rule only matches at the current position
+			bool crossLine = false;
+		private:
+			friend struct Scanner;
+			// registered from tokenType when a scann starts
+			TokenTypeRegistry::Id typeId = 0;
 		};
 
 		ScannRule& CreateRule()
 		{
 			auto tmp = new ScannRule;
 			rules.push_back(tmp);
+			dfa.reset();
+			cross_dfa.reset();
 			return *tmp;
 		}
 		ScannAction defaultAction;
 
+		ScannEngine engine = ScannEngine::Regex;
+
+		// build the DFA of ScannEngine::DFA now rather than on the first Scann()
+		// call it again after a rule is modified
+		MU_NOINLINE
+		void CompileDFA()
+		{
+			std::vector<FiniteAutomaton::Rule> dfa_rules;
+			for (auto rule : rules)
+			{
+				if (rule->expression.pattern.empty())
+					throw(Exception("Rule<" + rule->tokenType + "> has no regex pattern (built from std::regex), "
+						"which can't be compiled into DFA"));
+				dfa_rules.push_back({ rule->expression.pattern, rule->priority });
+			}
+			auto tmp = std::make_unique<FiniteAutomaton>();
+			tmp->Build(dfa_rules);
+			cross_rules.clear();
+			std::vector<FiniteAutomaton::Rule> cross_dfa_rules;
+			for (size_t i = 0; i < rules.size(); ++i)
+				if (rules[i]->crossLine)
+				{
+					cross_rules.push_back(i);
+					cross_dfa_rules.push_back(dfa_rules[i]);
+				}
+			cross_dfa.reset();
+			if (cross_rules.size())
+			{
+				cross_dfa = std::make_unique<FiniteAutomaton>();
+				cross_dfa->Build(cross_dfa_rules);
+			}
+			dfa = std::move(tmp);
+		}
+
 		std::vector<Token> Scann(const std::vector<LineContent>& input_text)
 		{
+			PrepareScann();
 			std::vector<Token> token_set;
-			auto skip_line = false;
+			std::string line_buffer;
 			for (size_t line = 0; line < input_text.size(); ++line)
 			{
 				const std::string& content = input_text[line].content;
-				auto line_head = content.cbegin();
-				auto begin = line_head;
-				auto end = content.cend();
-				while (!skip_line && begin != end)
+				ScannLine(content.data(), 0, 0, content.size(), content.size(),
+					input_text[line].line_no, token_set, &content, line_buffer);
+			}
+			Token end_token;
+			end_token.end_of_tokens = true;
+			token_set.push_back(std::move(end_token));
+			return token_set;
+		}
+
+		// scann a whole source, line by line, without a string per line
+		// the result keeps the source alive, so that the names of view tokens (e.g. EasyViewToken) never copy it
+		MU_NOINLINE
+		ScannResult<Token> ScannSource(std::shared_ptr<const InputSource> source)
+		{
+			PrepareScann();
+			ScannResult<Token> result;
+			result.source = std::move(source);
+			auto& input = *result.source;
+			std::string whole_text;
+			auto text_string = WholeTextForRegex(input, whole_text);
+			std::string line_buffer;
+			ScannLines(input, 0, 0, input.LineCount(), result.tokens, text_string, line_buffer);
+			Token end_token;
+			end_token.end_of_tokens = true;
+			result.tokens.push_back(std::move(end_token));
+			return result;
+		}
+
+		// the same tokens as ScannSource, the source is split into line-aligned chunks scanned on pool
+		// actions (onSucceed, defaultAction) run concurrently, they must not share unguarded state
+		// a chunk starting inside a token of a crossLine rule is rescanned after the previous chunk
+		MU_NOINLINE
+		ScannResult<Token> ScannParallel(std::shared_ptr<const InputSource> source, ThreadPool& pool = ThreadPool::Global())
+		{
+			PrepareScann();
+			ScannResult<Token> result;
+			result.source = std::move(source);
+			auto& input = *result.source;
+			std::string whole_text;
+			auto text_string = WholeTextForRegex(input, whole_text);
+
+			// chunk k scans lines [chunk_lines[k], chunk_lines[k + 1])
+			std::vector<size_t> chunk_lines = { 0 };
+			auto chunk_size = (std::max)(input.Size() / (pool.ThreadCount() * 4) + 1, parallelChunkSize);
+			for (auto offset = chunk_size; offset < input.Size(); offset += chunk_size)
+			{
+				auto line = input.LineOf(offset) + 1;
+				if (line < input.LineCount() && line > chunk_lines.back()) chunk_lines.push_back(line);
+			}
+			chunk_lines.push_back(input.LineCount());
+			auto chunk_count = chunk_lines.size() - 1;
+			auto ChunkBegin = [&](size_t k)
+			{ return chunk_lines[k] < input.LineCount() ? input.LineBegin(chunk_lines[k]) : input.Size(); };
+
+			std::vector<std::vector<Token>> chunk_tokens(chunk_count);
+			std::vector<size_t> chunk_exit(chunk_count);
+			std::vector<std::exception_ptr> chunk_error(chunk_count);
+			pool.ParallelFor(chunk_count, [&](size_t k)
 				{
-					Token buffer;
-					auto discard_token = false;
-					auto max_match = begin;
-					auto rule_iter = rules.begin();
-					auto rule_end = rules.end();
-					auto candidate = rule_end;
-					std::smatch candidate_match;
-					for (; rule_iter != rule_end; ++rule_iter)
-					{
-						std::smatch m;
-						if (std::regex_search(begin, end, m, (*rule_iter)->expression))
-						{
-							auto match_tail = m.suffix().first;
-							auto last = std::distance(begin, max_match);
-							auto current = std::distance(begin, match_tail);
-							if (last <= current)
-							{
-								auto substitute = true;
-								if (last == current 
-									&& candidate != rule_end 
-									&& (*candidate)->priority < (*rule_iter)->priority)
-								{
-									substitute = false;
-								}
-								if (substitute)
-								{
-									max_match = match_tail;
-									candidate = rule_iter;
-									candidate_match = m;
-								}
-							}
-						}
-					}
-					if (candidate != rule_end)
+					std::string line_buffer;
+					try
 					{
-						buffer.line = input_text[line].line_no;
-						buffer.start = std::distance(line_head, candidate_match.prefix().second);
-						buffer.end = std::distance(line_head, candidate_match.suffix().first) - 1;
-						buffer.name = candidate_match.str();
-						buffer.Type((*candidate)->tokenType);
-						ScannActionResult res = SaveToken;
-						if ((*candidate)->onSucceed) res = (*candidate)->onSucceed(candidate_match, buffer);
-						else if (defaultAction) res = defaultAction(candidate_match, buffer);
-						if (res & ScannActionResult::SkipCurrentLine) skip_line = true;
-						if (res & ScannActionResult::DiscardThisToken) discard_token = true;
+						chunk_exit[k] = ScannLines(input, chunk_lines[k], ChunkBegin(k), chunk_lines[k + 1],
+							chunk_tokens[k], text_string, line_buffer);
 					}
-					if (!discard_token) token_set.push_back(buffer);
-					if (begin == max_match) throw Exception("Oops...No match. Maybe check your Rules?");
-					begin = max_match;
-				}
-				if (skip_line)
+					catch (...) { chunk_error[k] = std::current_exception(); }
+				});
+
+			// a speculative chunk is right if the previous one exits at its first line
+			std::string line_buffer;
+			size_t token_count = 1;
+			for (size_t k = 0; k < chunk_count; ++k)
+			{
+				if (k > 0 && chunk_exit[k - 1] != ChunkBegin(k))
 				{
-					skip_line = false;
-					continue;
+					chunk_tokens[k].clear();
+					chunk_error[k] = nullptr;
+					auto begin = chunk_exit[k - 1];
+					if (begin >= ChunkBegin(k + 1)) chunk_exit[k] = begin;
+					else chunk_exit[k] = ScannLines(input, input.LineOf(begin), begin, chunk_lines[k + 1],
+						chunk_tokens[k], text_string, line_buffer);
 				}
+				if (chunk_error[k]) std::rethrow_exception(chunk_error[k]);
+				token_count += chunk_tokens[k].size();
+			}
+
+			result.tokens.reserve(token_count);
+			for (auto& tokens : chunk_tokens)
+			{
+				std::move(tokens.begin(), tokens.end(), std::back_inserter(result.tokens));
+				std::vector<Token>().swap(tokens);
 			}
 			Token end_token;
 			end_token.end_of_tokens = true;
-			token_set.push_back(std::move(end_token));
-			return token_set;
+			result.tokens.push_back(std::move(end_token));
+			return result;
+		}
+
+		ScannResult<Token> ScannParallel(std::string text, size_t first_line_no = 1)
+		{
+			return ScannParallel(InputSource::Own(std::move(text), first_line_no));
+		}
+
+		ScannResult<Token> ScannSource(std::string text, size_t first_line_no = 1)
+		{
+			return ScannSource(InputSource::Own(std::move(text), first_line_no));
+		}
+
+		// tokens are scanned line by line as the parser asks for them, instead of all at once
+		// the scanner must outlive the stream
+		MU_NOINLINE
+		TokenStream<Token> ScannStream(std::shared_ptr<const InputSource> source)
+		{
+			PrepareScann();
+			struct State
+			{
+				std::shared_ptr<const InputSource> source;
+				std::string whole_text;
+				const std::string* text_string = nullptr;
+				std::string line_buffer;
+				size_t offset = 0;
+			};
+			auto state = std::make_shared<State>();
+			state->source = source;
+			state->text_string = WholeTextForRegex(*source, state->whole_text);
+			return TokenStream<Token>([this, state](std::vector<Token>& tokens)
+				{
+					auto& input = *state->source;
+					if (state->offset < input.Size())
+					{
+						auto line = input.LineOf(state->offset);
+						state->offset = ScannLines(input, line, state->offset, line + 1,
+							tokens, state->text_string, state->line_buffer);
+						if (state->offset < input.Size()) return true;
+					}
+					Token end_token;
+					end_token.end_of_tokens = true;
+					tokens.push_back(std::move(end_token));
+					return false;
+				}, std::move(source));
+		}
+
+		// the same as ScannSource, but every token is packed into a CompactToken once its action is done
+		// a token member "type" (e.g. EasyToken::type) is kept as CompactToken::kind
+		// keep_colors keeps the "color" of tokens in result.colors, only needed by Highlight
+		MU_NOINLINE
+		ScannResult<CompactToken> ScannCompact(std::shared_ptr<const InputSource> source, bool keep_colors = false)
+		{
+			if (source->Size() > UINT32_MAX) throw(Exception("CompactToken can't address a source over 4GB"));
+			PrepareScann();
+			ScannResult<CompactToken> result;
+			result.source = std::move(source);
+			auto& input = *result.source;
+			std::string whole_text;
+			auto text_string = WholeTextForRegex(input, whole_text);
+			std::string line_buffer;
+			CompactTokenSet compact{ input, result.tokens, keep_colors ? &result.colors : nullptr };
+			ScannLines(input, 0, 0, input.LineCount(), compact, text_string, line_buffer);
+			CompactToken end_token;
+			end_token.offset = (uint32_t)input.Size();
+			end_token.flags = CompactToken::end_flag;
+			result.tokens.push_back(end_token);
+			if (keep_colors) result.colors.push_back(Debug::ConsoleForegroundColor::White);
+			return result;
 		}
+
+		// lower bound of the bytes per chunk of ScannParallel
+		size_t parallelChunkSize = 1 << 16;
+
 		~Scanner() { for (auto rule : rules) delete rule; }
 	private:
+		using Iter = std::string::const_iterator;
 		std::vector<ScannRule*> rules;
+		std::unique_ptr<FiniteAutomaton> dfa;
+		// crossLine rules only, matched to the end of the source
+		std::unique_ptr<FiniteAutomaton> cross_dfa;
+		std::vector<size_t> cross_rules;
+
+		template<class T, class = void>
+		struct HasKind : std::false_type {};
+		template<class T>
+		struct HasKind<T, std::void_t<decltype((uint16_t)std::declval<T&>().type)>> : std::true_type {};
+		template<class T, class = void>
+		struct HasColor : std::false_type {};
+		template<class T>
+		struct HasColor<T, std::void_t<decltype(std::declval<T&>().color)>> : std::true_type {};
+
+		// packs tokens of ScannLines into CompactToken
+		struct CompactTokenSet
+		{
+			const InputSource& input;
+			std::vector<CompactToken>& tokens;
+			std::vector<Debug::ConsoleForegroundColor>* colors;
+
+			void push_back(const Token& token)
+			{
+				CompactToken compact;
+				compact.offset = (uint32_t)(input.LineBegin(token.line - input.FirstLineNo()) + token.start);
+				compact.length = (uint32_t)(token.end + 1 - token.start);
+				compact.type_id = token.TypeId();
+				if constexpr (HasKind<Token>::value) compact.kind = (uint16_t)token.type;
+				tokens.push_back(compact);
+				if (colors)
+				{
+					if constexpr (HasColor<Token>::value) colors->push_back(token.color);
+					else colors->push_back(Debug::ConsoleForegroundColor::White);
+				}
+			}
+		};
+
+		void PrepareScann()
+		{
+			if (engine == ScannEngine::DFA && !dfa) CompileDFA();
+			for (auto rule : rules) rule->typeId = TokenTypeRegistry::Register(rule->tokenType);
+		}
+
+		bool HasCrossLineRule() const
+		{
+			for (auto rule : rules) if (rule->crossLine) return true;
+			return false;
+		}
+
+		// std::regex needs a std::string, a crossLine rule needs the whole text in one
+		// otherwise the regex engine copies line by line
+		const std::string* WholeTextForRegex(const InputSource& input, std::string& whole_text) const
+		{
+			if (engine != ScannEngine::Regex || !HasCrossLineRule()) return nullptr;
+			whole_text.assign(input.Data(), input.Size());
+			return &whole_text;
+		}
+
+		// scann from offset begin in line first_line to the end of line last_line - 1
+		// returns where the scan stopped, after last_line if a crossLine token runs over it
+		template<class TokenSet>
+		size_t ScannLines(const InputSource& input, size_t first_line, size_t begin, size_t last_line,
+			TokenSet& token_set, const std::string* text_string, std::string& line_buffer)
+		{
+			auto line = first_line;
+			while (line < last_line)
+			{
+				auto line_end = input.LineEnd(line);
+				auto stop = ScannLine(input.Data(), input.LineBegin(line), begin, line_end, input.Size(),
+					input.FirstLineNo() + line, token_set, text_string, line_buffer);
+				if (stop > line_end)
+				{
+					if (stop >= input.Size()) return input.Size();
+					line = input.LineOf(stop);
+					begin = stop;
+				}
+				else if (++line < input.LineCount()) begin = input.LineBegin(line);
+				else return input.Size();
+			}
+			return begin;
+		}
+
+		// scann text[begin, line_end) of the line starting at text[line_head]
+		// tokens of crossLine rules may run to text_end, then the offset past the token is returned
+		// text_string is the same text if it is held by a std::string, otherwise std::regex works on line_buffer
+		template<class TokenSet>
+		size_t ScannLine(const char* text, size_t line_head, size_t begin, size_t line_end, size_t text_end,
+			size_t line_no, TokenSet& token_set, const std::string* text_string, std::string& line_buffer)
+		{
+			size_t string_base = 0;
+			if (engine == ScannEngine::Regex && !text_string)
+			{
+				line_buffer.assign(text + line_head, line_end - line_head);
+				text_string = &line_buffer;
+				string_base = line_head;
+			}
+			auto skip_line = false;
+			while (!skip_line && begin < line_end)
+			{
+				Token buffer;
+				auto discard_token = false;
+				size_t match_head = begin;
+				size_t max_match = begin;
+				std::smatch candidate_match;
+				ScannRule* candidate = nullptr;
+				if (engine == ScannEngine::DFA)
+					candidate = MatchDFA(text + begin, text + line_end, text + text_end, max_match);
+				else
+				{
+					auto str_begin = text_string->cbegin();
+					Iter head = str_begin + (begin - string_base), tail = head;
+					candidate = MatchRegex(head, str_begin + (line_end - string_base),
+						str_begin + ((std::min)(text_end, string_base + text_string->size()) - string_base),
+						candidate_match, head, tail);
+					match_head = string_base + std::distance(str_begin, head);
+					max_match = string_base + std::distance(str_begin, tail);
+				}
+				if (candidate)
+				{
+					buffer.line = line_no;
+					buffer.start = match_head - line_head;
+					buffer.end = max_match - line_head - 1;
+					if constexpr (std::is_same_v<decltype(buffer.name), std::string_view>)
+						buffer.name = std::string_view(text + match_head, max_match - match_head);
+					else
+						buffer.name.assign(text + match_head, max_match - match_head);
+					buffer.TypeId(candidate->typeId);
+					ScannActionResult res = SaveToken;
+					if (candidate->onSucceed) res = candidate->onSucceed(candidate_match, buffer);
+					else if (defaultAction) res = defaultAction(candidate_match, buffer);
+					if (res & ScannActionResult::SkipCurrentLine) skip_line = true;
+					if (res & ScannActionResult::DiscardThisToken) discard_token = true;
+				}
+				if (begin == max_match) throw Exception("Oops...No match. Maybe check your Rules?");
+				if (!discard_token) token_set.push_back(buffer);
+				begin = max_match;
+			}
+			return (std::max)(begin, line_end);
+		}
+
+		// every rule searches by itself, the longest match wins
+		// on the same length, the smaller priority wins, then the later rule
+		// crossLine rules match at begin only, but may run to text_end
+		ScannRule* MatchRegex(Iter begin, Iter end, Iter text_end, std::smatch& candidate_match, Iter& match_head, Iter& max_match)
+		{
+			ScannRule* candidate = nullptr;
+			for (auto rule : rules)
+			{
+				std::smatch m;
+				auto matched = rule->crossLine
+					? std::regex_search(begin, text_end, m, rule->expression.regex, std::regex_constants::match_continuous)
+					: std::regex_search(begin, end, m, rule->expression.regex);
+				if (matched)
+				{
+					auto match_tail = m.suffix().first;
+					auto last = std::distance(begin, max_match);
+					auto current = std::distance(begin, match_tail);
+					if (last <= current)
+					{
+						auto substitute = true;
+						if (last == current
+							&& candidate
+							&& candidate->priority < rule->priority)
+						{
+							substitute = false;
+						}
+						if (substitute)
+						{
+							max_match = match_tail;
+							match_head = m.prefix().second;
+							candidate = rule;
+							candidate_match = m;
+						}
+					}
+				}
+			}
+			return candidate;
+		}
+
+		// one pass of the DFA, the same maximal-munch and priority resolution as MatchRegex
+		// no std::smatch is produced, the action receives an empty one
+		ScannRule* MatchDFA(const char* begin, const char* end, const char* text_end, size_t& max_match)
+		{
+			size_t length = 0;
+			auto rule = dfa->Match(begin, end, length);
+			if (cross_dfa && text_end != end)
+			{
+				size_t cross_length = 0;
+				auto cross = cross_dfa->Match(begin, text_end, cross_length);
+				if (cross != FiniteAutomaton::npos)
+				{
+					cross = cross_rules[cross];
+					if (rule == FiniteAutomaton::npos || cross_length > length
+						|| (cross_length == length && (rules[cross]->priority < rules[rule]->priority
+							|| (rules[cross]->priority == rules[rule]->priority && cross > rule))))
+					{
+						rule = cross;
+						length = cross_length;
+					}
+				}
+			}
+			if (rule == FiniteAutomaton::npos) return nullptr;
+			max_match += length;
+			return rules[rule];
+		}
 	};
 }
\ No newline at end of file
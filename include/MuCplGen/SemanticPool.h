@@ -0,0 +1,44 @@
+#pragma once
+#include <deque>
+#include <any>
+#include <utility>
+
+namespace MuCplGen
+{
+	// the std::any slots semantic actions return their values in
+	// a parse takes slots one after another, Reset destroys the values and keeps the slots for the next parse,
+	// so a parser running over many inputs holds as many slots as its largest parse needed
+	class SemanticPool
+	{
+	public:
+		template<class T>
+		std::any* Emplace(T&& value)
+		{
+			if (used == slots.size()) slots.emplace_back();
+			auto* slot = &slots[used++];
+			slot->emplace<std::decay_t<T>>(std::forward<T>(value));
+			return slot;
+		}
+
+		void Reset()
+		{
+			for (size_t i = 0; i < used; ++i) slots[i].reset();
+			used = 0;
+		}
+
+		// drops the slots too
+		void Clear()
+		{
+			slots.clear();
+			used = 0;
+		}
+
+		size_t Used() const { return used; }
+		size_t Capacity() const { return slots.size(); }
+
+	private:
+		// deque: taking a slot never moves the values already returned
+		std::deque<std::any> slots;
+		size_t used = 0;
+	};
+}
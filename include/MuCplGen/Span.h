@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <type_traits>
+
+namespace MuCplGen
+{
+	// a view of contiguous elements owned elsewhere,
+	// e.g. the semantic values of a reduction, which stay in the parser's stack
+	template<class T>
+	class Span
+	{
+	public:
+		using value_type = std::remove_const_t<T>;
+
+		Span() = default;
+		Span(T* data, size_t size) : ptr(data), count(size) {}
+		Span(std::vector<value_type>& values) : ptr(values.data()), count(values.size()) {}
+		template<class U = T, std::enable_if_t<std::is_const_v<U>, int> = 0>
+		Span(const std::vector<value_type>& values) : ptr(values.data()), count(values.size()) {}
+		// e.g. Span<const int> from Span<int>
+		template<class U, std::enable_if_t<std::is_convertible_v<U(*)[], T(*)[]>, int> = 0>
+		Span(const Span<U>& other) : ptr(other.data()), count(other.size()) {}
+
+		T* data() const { return ptr; }
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+		T* begin() const { return ptr; }
+		T* end() const { return ptr + count; }
+		T& operator[](size_t i) const { return ptr[i]; }
+		T& front() const { return ptr[0]; }
+		T& back() const { return ptr[count - 1]; }
+
+		std::vector<value_type> ToVector() const { return std::vector<value_type>(begin(), end()); }
+
+	private:
+		T* ptr = nullptr;
+		size_t count = 0;
+	};
+}
@@ -7,10 +7,16 @@
 #include <fstream>
 #include <sstream>
 #include <typeinfo>
+#include <typeindex>
 #include <functional>
+#include <algorithm>
+#include <limits>
 #include <any>
 #include "FileLoader.h"
 #include "EasyScanner.h"
+#include "TokenStream.h"
+#include "ThreadPool.h"
+#include "KeywordTable.h"
 #include "DebugTool/Highlight.h"
 #include "Parser.h"
 #include "SealedValue.h"
@@ -32,6 +38,12 @@ namespace MuCplGen
 	protected:
 		std::list<ParseRule*> parse_rules;
 		std::string current_scope;
+		// values returned by the semantic actions of the parse running
+		SemanticPool semantic_pool;
+		// the value of the entrance rule, kept after the parse until taken
+		std::any parse_result;
+		// by scoped nonterm name, see DeclareType
+		std::unordered_map<std::string, std::type_index> declared_types;
 	public:
 		void Scope(const std::string& scope) { current_scope = scope; }
 		const std::string& Scope() { return current_scope; }
@@ -40,6 +52,7 @@ namespace MuCplGen
 		{
 			auto tmp = new ParseRule;
 			tmp->scope = current_scope;
+			tmp->pool = &semantic_pool;
 			parse_rules.push_back(tmp);
 			return *tmp;
 		}
@@ -48,10 +61,37 @@ namespace MuCplGen
 		{
 			auto tmp = new ParseRule;
 			tmp->scope = current_scope;
+			tmp->pool = &semantic_pool;
 			parse_rules.push_front(tmp);
 			return *tmp;
 		}
 
+		// opt-in typed mode: the values of nonterm are T
+		// Build() checks the actions against the declared types once,
+		// then the actions whose arguments are all declared read them without type checks
+		template<class T>
+		void DeclareType(const std::string& nonterm)
+		{
+			auto name = current_scope.empty() || nonterm.find(".") != std::string::npos ? nonterm : current_scope + "." + nonterm;
+			declared_types.insert_or_assign(name, std::type_index(typeid(T)));
+		}
+
+		bool HasParseResult() const { return parse_result.has_value(); }
+
+		// moves out the value the entrance rule returned in the last accepted parse
+		// every other semantic value is destroyed when the parse completes
+		template<class T>
+		T TakeParseResult()
+		{
+			if (!parse_result.has_value()) throw(Exception("No parse result, the last parse was not accepted or it was taken"));
+			if (parse_result.type() != typeid(T))
+				throw(Exception(std::string("Unmatched Type! parse result type=") + parse_result.type().name()
+					+ " asked type=" + typeid(T).name()));
+			auto result = std::any_cast<T>(std::move(parse_result));
+			parse_result.reset();
+			return result;
+		}
+
 		~BaseSyntaxDirected()
 		{
 			for (auto rule : parse_rules) delete rule;
@@ -70,6 +110,7 @@ namespace MuCplGen
 		using Production = std::vector<Sym>;
 		using Productions = std::vector<Production>;
 		using ProductionTable = std::vector<Productions>;
+		using Grammar = typename PushDownAutomaton<Sym>::Grammar;
 
 
 		Sym start = 0;
@@ -80,66 +121,147 @@ namespace MuCplGen
 		std::unordered_map<std::string, Sym> name_to_sym;
 		std::vector<std::string> sym_to_name;
 
-		ProductionTable production_table;
+		// built by SetupSymbols, the parser is set up from it
+		Grammar grammar;
 	protected:
 		using SemanticAction = std::function<std::any* (std::vector<std::any*>, size_t, TokenSet&)>;
 		std::ostream& log;
 	private:
 		std::list<Term*> terminator_rules;
 		std::list<Term*> wild_terminators;
-		std::vector<std::vector<ParseRule*>> quick_parse_rule_table;
+		// in the order of the productions of grammar, the rule of production p is production_rules[p]
+		std::vector<ParseRule*> production_rules;
 		//std::vector<Sym> expects, size_t token_iter
 		std::function<void(std::vector<Sym>, size_t)> error_action;
 
+		// terminator_rules compiled by Build(), see CompileTerminators
+		KeywordTable literal_table;
+		// by index in literal_table.Words()
+		std::vector<Sym> literal_syms;
+		// by token type, the user terminators to try, in the order they were created
+		std::vector<std::vector<Term*>> kind_terms;
+		// the user terminators to try for a token type out of kind_terms
+		std::vector<Term*> any_kind_terms;
+
+		// a smaller priority wins, the first created wins a tie, a wild terminator has priority 0
+		// and comes after all user terminators, so a user terminator with priority 0 wins over it
 		MU_NOINLINE Sym	TokenToTerminator(const Token& token)
 		{
+			if (token.IsEndToken()) return end;
+			auto* terms = &any_kind_terms;
+			if constexpr (TerminatorKind<Token>::indexed)
+			{
+				auto kind = TerminatorKind<Token>::Of(token);
+				if (kind < kind_terms.size()) terms = &kind_terms[kind];
+			}
 			Sym sym = -1;
-			size_t priority = -1;
+			auto priority = (std::numeric_limits<int>::max)();
+			for (auto term : *terms)
+			{
+				if (term->priority >= priority || !term->translation(token)) continue;
+				if (term->priority == 0) return term->sym;
+				priority = term->priority;
+				sym = term->sym;
+			}
+			auto literal = literal_table.Find(TokenText(token));
+			if (literal != KeywordTable::npos) return literal_syms[literal];
+			if (sym == (Sym)-1)
+				throw(std::logic_error("TokenToTerminator Failed"));
+			else return sym;
+		}
+
+		// wild terminators go to a perfect hash of their text, user terminators to buckets by tokenTypes
+		MU_NOINLINE void CompileTerminators()
+		{
+			std::vector<std::string> literals;
+			for (auto term : wild_terminators) literals.push_back(term->name);
+			literal_table.Build(literals);
+			literal_syms.assign(literal_table.Words().size(), 0);
+			for (auto term : wild_terminators) literal_syms[literal_table.Find(term->name)] = term->sym;
+
+			size_t kind_count = 0;
+			for (auto term : terminator_rules)
+				if (!term->wild)
+					for (auto kind : term->tokenTypes) kind_count = (std::max)(kind_count, (size_t)kind + 1);
+			kind_terms.assign(kind_count, {});
+			any_kind_terms.clear();
 			for (auto term : terminator_rules)
 			{
-				bool success = term->translation(token);
-				if (success && term->priority == 0)
+				if (term->wild) continue;
+				if (term->tokenTypes.empty())
 				{
-					sym = term->sym;
-					break;
+					any_kind_terms.push_back(term);
+					for (auto& terms : kind_terms) terms.push_back(term);
 				}
-				else if (success)
+				else for (auto kind : term->tokenTypes)
 				{
-					if (term->priority < priority) priority = term->priority;
-					sym = term->sym;
+					auto& terms = kind_terms[(size_t)kind];
+					if (terms.empty() || terms.back() != term) terms.push_back(term);
 				}
 			}
-			if (token.IsEndToken()) return end;
-			if (sym == (Sym)-1)
-				throw(std::logic_error("TokenToTerminator Failed"));
-			else return sym;
 		}
 
-		MU_NOINLINE std::any* SemanticActionDispatcher(std::vector<std::any*> input, size_t nonterm, size_t pro_index, size_t token_iter)
+		ParseRule* RuleOf(size_t nonterm, size_t pro_index) const { return production_rules[grammar.ProductionOf(nonterm, pro_index)]; }
+
+		// error_bits[i]: the value at i of the semantic stack is a semantic error
+		// every bit from error_top up is clear, so a body above error_top is checked with one compare
+		std::vector<uint64_t> error_bits;
+		size_t error_top = 0;
+
+		bool ErrorAt(size_t i) const { return (error_bits[i / 64] >> (i % 64)) & 1; }
+
+		// value is the result of the reduction whose body started at position at, the values above it were popped
+		std::any* RecordError(size_t at, std::any* value)
+		{
+			for (auto i = at; i < error_top; ++i) error_bits[i / 64] &= ~(1ull << (i % 64));
+			error_top = (std::min)(error_top, at);
+			auto error = std::any_cast<ParserErrorData>(value);
+			if (error && error->code == ParserErrorCode::SemanticError)
+			{
+				if (error_bits.size() <= at / 64) error_bits.resize(at / 64 + 1, 0);
+				error_bits[at / 64] |= 1ull << (at % 64);
+				error_top = at + 1;
+			}
+			return value;
+		}
+
+		void ClearErrors()
+		{
+			for (size_t word = 0; word < (error_top + 63) / 64; ++word) error_bits[word] = 0;
+			error_top = 0;
+		}
+
+		MU_NOINLINE std::any* SemanticActionDispatcher(SemanticValues input, size_t nonterm, size_t pro_index, size_t token_iter)
 		{
-			auto rule = quick_parse_rule_table[nonterm][pro_index];
+			auto rule = RuleOf(nonterm, pro_index);
 			this->token_iter = token_iter;
+			auto base = (size_t)(input.data() - my_parser.semantic_stack.data());
 			auto error_pos = -1;
-			auto error_data = NextSemanticError(input, error_pos);
-			if (error_data)
+			for (auto i = base; i < (std::min)(base + input.size(), error_top); ++i)
+				if (ErrorAt(i))
+				{
+					error_pos = (int)(i - base);
+					break;
+				}
+			if (error_pos != -1)
 			{
 				if (debug_option & DebugOption::ShowReductionProcess)
 				{
 					log << rule->fullname_expression << " Action{" << rule->action_name << "}"
-						"[" << (*token_set)[token_iter].name << "]=> Semantic Error Occurs" << std::endl;
+						"[" << TokenText(TokenAt(token_iter)) << "]=> Semantic Error Occurs" << std::endl;
 				}
-				if (rule->semantic_error) return rule->semantic_error(input);
-				else return input[error_pos];
+				if (rule->semantic_error) return RecordError(base, rule->semantic_error(input));
+				else return RecordError(base, input[error_pos]);
 			}
 			else
 			{
 				if (debug_option & DebugOption::ShowReductionProcess)
 				{
 					log << rule->fullname_expression << " Action{" << rule->action_name << "}" 
-					"["<< (*token_set)[token_iter].name <<"]"<< std::endl;
+					"["<< TokenText(TokenAt(token_iter)) <<"]"<< std::endl;
 				}
-				if (rule->semantic_action == nullptr) return nullptr;
-				else return rule->semantic_action(input);
+				if (rule->semantic_action == nullptr) return RecordError(base, nullptr);
+				else return RecordError(base, rule->semantic_action(input));
 			}
 		}
 
@@ -149,25 +271,56 @@ namespace MuCplGen
 			{
 				if (debug_option & DebugOption::SyntaxError)
 				{
-					if (input_text)
+					if (input_text || input_source || token_stream)
 					{
 						std::stringstream ss;
 						ss << "Expected Symbol:";
 						for (const auto& item : expects)
 							ss << " \'" << sym_to_name[item] << "\' ";
-						Highlight(*(input_text), *(token_set), { { token_iter, ss.str() } }, log);
+						if constexpr (std::is_same_v<Token, CompactToken>)
+						{
+							static const std::vector<ConsoleForegroundColor> no_color;
+							if (input_source && token_set) Highlight(*(input_source), *(token_set),
+								token_colors ? *token_colors : no_color, { { token_iter, ss.str() } }, log);
+						}
+						else if (token_stream) HighlightStreamLine(token_iter, ss.str());
+						else if (input_text) Highlight(*(input_text), *(token_set), { { token_iter, ss.str() } }, log);
+						else Highlight(*(input_source), *(token_set), { { token_iter, ss.str() } }, log);
 					}
-					if ((*token_set)[token_iter].IsEndToken())
+					if (TokenAt(token_iter).IsEndToken())
 					{
-						if (token_iter > 0) log << "Missing Token After:\n" << (*token_set)[token_iter - 1] << std::endl;
+						if (token_iter > 0) log << "Missing Token After:\n" << TokenAt(token_iter - 1) << std::endl;
 						else log << "No Symbol At All!" << std::endl;
 					}
-					else log << "Error Token:\n" << (*token_set)[token_iter] << std::endl;
+					else log << "Error Token:\n" << TokenAt(token_iter) << std::endl;
 				}
 			}
 			else error_action(std::move(expects), token_iter);
 		}
 
+		// only the line of the error token is still at hand in a TokenStream
+		void HighlightStreamLine(size_t error_iter, const std::string& error_info)
+		{
+			if constexpr (!std::is_same_v<Token, CompactToken>)
+			{
+				if (!input_source) return;
+				auto& error_token = TokenAt(error_iter);
+				if (error_token.IsEndToken() && (error_iter == 0 || error_iter - 1 < token_stream->Base())) return;
+				auto line_no = error_token.IsEndToken() ? TokenAt(error_iter - 1).line : error_token.line;
+				std::vector<LineContent> line = { { std::string(input_source->Line(line_no - input_source->FirstLineNo())), line_no } };
+				std::vector<Token> line_tokens;
+				size_t error_index = -1;
+				token_stream->ForEachBuffered(0, [&](size_t i, const Token& token)
+					{
+						if (token.IsEndToken() || token.line != line_no) return;
+						if (i == error_iter) error_index = line_tokens.size();
+						line_tokens.push_back(token);
+					});
+				if (error_index == (size_t)-1) Highlight(line, line_tokens, log);
+				else Highlight(line, line_tokens, { { error_index, error_info } }, log);
+			}
+		}
+
 		std::string ScopedName(const std::string& scope, const std::string& name)
 		{
 			if (scope.empty()) return name;
@@ -184,7 +337,7 @@ namespace MuCplGen
 			}
 		}
 
-		void PrintProduction(Sym i, const Production& p)
+		void PrintProduction(Sym i, Span<const Sym> p)
 		{
 			log << sym_to_name[i] << " -> ";
 			for (auto b : p) log << sym_to_name[b] << " ";
@@ -194,21 +347,20 @@ namespace MuCplGen
 
 		void PrintProductions(Sym i)
 		{
-			for (auto& production : production_table[i]) PrintProduction(i, production);
+			for (size_t p = grammar.nonterm_begin[i]; p < grammar.nonterm_begin[i + 1]; ++p) PrintProduction(i, grammar.Body(p));
 		}
 
 		void PrintUpperRelativeProductions(Sym s)
 		{
-			for (size_t i = 0; i < production_table.size(); ++i)
-				for (auto& p : production_table[i])
-					for (auto sym : p)
+			for (size_t p = 0; p < grammar.ProductionCount(); ++p)
+				for (auto sym : grammar.Body(p))
+				{
+					if (sym == s)
 					{
-						if (sym == s)
-						{
-							PrintProduction(i, p);
-							break;
-						}
+						PrintProduction(grammar.heads[p], grammar.Body(p));
+						break;
 					}
+				}
 		}
 
 		MU_NOINLINE void SetupSymbols()
@@ -222,8 +374,8 @@ namespace MuCplGen
 				CheckAndAddSymbol(rule->ScopedName(rule->head));
 			}
 
-			production_table.resize(sym_to_name.size());
-			quick_parse_rule_table.resize(sym_to_name.size());
+			ProductionTable production_table(sym_to_name.size());
+			std::vector<std::vector<ParseRule*>> rules_of_nonterm(sym_to_name.size());
 			epsilon = sym_to_name.size();
 			name_to_sym.insert({ "epsilon",sym_to_name.size() });
 			sym_to_name.push_back("epsilon");
@@ -260,9 +412,9 @@ namespace MuCplGen
 							production.push_back(sym);
 
 							auto& t = CreateWildTerminator(body);
-							t.translation = [&t](const Token& token)
+							t.translation = [this, &t](const Token& token)
 							{
-								return t.name == token.name;
+								return t.name == TokenText(token);
 							};
 							t.sym = sym;
 						}
@@ -277,14 +429,19 @@ namespace MuCplGen
 				for (auto& p : production) ss << sym_to_name[p] << " ";
 				rule->fullname_expression = ss.str();
 				production_table[name_to_sym[head]].push_back(std::move(production));
-				quick_parse_rule_table[name_to_sym[head]].push_back(rule);
+				rules_of_nonterm[name_to_sym[head]].push_back(rule);
 			}
+			grammar = Grammar(production_table);
+			production_rules.clear();
+			for (auto& rules : rules_of_nonterm)
+				production_rules.insert(production_rules.end(), rules.begin(), rules.end());
 
 			end = sym_to_name.size();
 			sym_to_name.push_back("$");
 			name_to_sym["$"] = end;
 
 			for (auto rule : end_term) rule->sym = end;
+			CompileTerminators();
 
 			if (debug_option & DebugOption::ShowCatchedVariables)
 			{
@@ -294,14 +451,14 @@ namespace MuCplGen
 			if (debug_option & DebugOption::ShowProductionTable)
 			{
 				log << "Production Table:" << std::endl;
-				for (size_t i = 0; i < production_table.size(); ++i) PrintProductions(i);
+				for (size_t i = 0; i < grammar.NontermCount(); ++i) PrintProductions(i);
 			}
 			if (debug_option & DebugOption::ShowCatchedWildTerminator)
 			{
 				log << "Wild Terminators:" << std::endl;
 				for (auto t : wild_terminators) log << t->name << std::endl;
 			}
-			if (production_table[0].size() > 1)
+			if (grammar.ProductionCountOf(0) > 1)
 			{
 				SetConsoleColor(log, ConsoleForegroundColor::Red);
 				log << "Parse Entrance allow only one production, yours:" << std::endl;
@@ -309,17 +466,210 @@ namespace MuCplGen
 				SetConsoleColor(log);
 				throw(Exception("Parse Entrance Rule is illegal! Check your log to get error info"));
 			}
+			CheckDeclaredTypes();
+		}
+
+		// the type of the values of sym, void if it is not known
+		std::type_index ValueType(Sym sym, const std::vector<std::type_index>& nonterm_types)
+		{
+			if (sym >= epsilon) return typeid(Empty);
+			return nonterm_types[sym];
+		}
+
+		// a type mismatch with a declared type fails the build, a rule whose arguments are all known is typed
+		MU_NOINLINE void CheckDeclaredTypes()
+		{
+			for (auto rule : parse_rules) rule->typed = false;
+			if (declared_types.empty()) return;
+			std::vector<std::type_index> nonterm_types(epsilon, typeid(void));
+			for (auto& [name, type] : declared_types)
+			{
+				auto iter = name_to_sym.find(name);
+				if (iter == name_to_sym.end() || iter->second >= epsilon)
+					throw(Exception("DeclareType: " + name + " is not a nonterm"));
+				nonterm_types[iter->second] = type;
+			}
+			const std::type_index unknown = typeid(void);
+			std::vector<std::string> errors;
+			for (Sym head = 0; head < epsilon; ++head)
+				for (size_t i = 0; i < grammar.ProductionCountOf(head); ++i)
+				{
+					auto rule = RuleOf(head, i);
+					auto body = grammar.Body(head, i);
+					auto error_count = errors.size();
+					auto mismatch = [&](const std::string& what, std::type_index expected, std::type_index type)
+					{
+						errors.push_back(rule->fullname_expression + ": " + what + " is " + type.name()
+							+ ", declared " + expected.name());
+					};
+
+					auto head_type = nonterm_types[head];
+					if (head_type != unknown)
+					{
+						auto made = unknown;
+						if (rule->pass_on >= 0)
+						{
+							if ((size_t)rule->pass_on < body.size()) made = ValueType(body[rule->pass_on], nonterm_types);
+							else errors.push_back(rule->fullname_expression + ": PassOn(" + std::to_string(rule->pass_on) + ") is out of the body");
+						}
+						else if (rule->semantic_action == nullptr) made = typeid(Empty);
+						else if (rule->ret_type != typeid(PassOn))
+							made = rule->ret_type == typeid(std::nullptr_t) ? std::type_index(typeid(Empty)) : rule->ret_type;
+						if (made != unknown && made != head_type) mismatch("the value", head_type, made);
+						if (rule->semantic_error && rule->error_ret_type != typeid(PassOn) && rule->error_ret_type != head_type)
+							mismatch("the value of the semantic error action", head_type, rule->error_ret_type);
+					}
+
+					if (rule->pass_on >= 0 || rule->semantic_action == nullptr) continue;
+					auto& args = rule->arg_types;
+					if (args.size() > body.size())
+					{
+						errors.push_back(rule->fullname_expression + ": the action takes " + std::to_string(args.size())
+							+ " arguments, the body has " + std::to_string(body.size()));
+						continue;
+					}
+					// the arguments are the last args.size() values of the body
+					bool known = true;
+					for (size_t arg = 0; arg < args.size(); ++arg)
+					{
+						auto type = ValueType(body[body.size() - args.size() + arg], nonterm_types);
+						if (type == unknown) known = false;
+						else if (type != args[arg]) mismatch("Arg" + std::to_string(arg), type, args[arg]);
+					}
+					rule->typed = known && errors.size() == error_count;
+				}
+			if (errors.size())
+			{
+				SetConsoleColor(log, ConsoleForegroundColor::Red);
+				log << "Semantic Actions do not match the declared types:" << std::endl;
+				for (auto& error : errors) log << error << std::endl;
+				SetConsoleColor(log);
+				throw(Exception("Semantic Action type is illegal! Check your log to get error info"));
+			}
 		}
 
 		size_t token_iter = 0;
 		TokenSet* token_set = nullptr;
+		TokenStream<Token>* token_stream = nullptr;
 		std::vector<LineContent>* input_text = nullptr;
+		std::shared_ptr<const InputSource> input_source;
+		const std::vector<ConsoleForegroundColor>* token_colors = nullptr;
 		std::string storage = "";
 		bool build_error = true;
+
+		// terminators of the token vector, classified once when the parser first reads them
+		// or in batches ahead of the parser with parallelClassify, token_syms[i] is current while sym_epochs[i] == sym_epoch
+		std::vector<Sym> token_syms;
+		std::vector<uint32_t> sym_epochs;
+		uint32_t sym_epoch = 0;
+		size_t classified_end = 0;
+		size_t classify_batch = 0;
+
+		bool ParseTokens(TokenSet& token_set, size_t start_token)
+		{
+			this->token_set = &token_set;
+			this->token_stream = nullptr;
+			PrepareParser();
+			my_parser.ReserveStacks(token_set.size() > start_token ? token_set.size() - start_token : 0);
+			if (token_syms.size() < token_set.size())
+			{
+				token_syms.resize(token_set.size());
+				sym_epochs.resize(token_set.size(), 0);
+			}
+			InvalidateTerminators();
+			classified_end = start_token;
+			classify_batch = 0;
+			return FinishParse(RunParser(start_token, [this](size_t i)
+				{
+					return i < this->token_set->size() ? TerminatorAt(i) : my_parser.no_token;
+				}));
+		}
+
+		Sym TerminatorAt(size_t i)
+		{
+			if (parallelClassify && i >= classified_end) ClassifyAhead(i);
+			if (sym_epochs[i] != sym_epoch)
+			{
+				token_syms[i] = TokenToTerminator((*token_set)[i]);
+				sym_epochs[i] = sym_epoch;
+			}
+			return token_syms[i];
+		}
+
+		// the batch doubles as the parser gets further, so a sub parser stopping early classifies little
+		// a token no terminator takes is left stale, it throws when the parser gets to it
+		MU_NOINLINE void ClassifyAhead(size_t i)
+		{
+			classify_batch = (std::min)((std::max)(classify_batch * 2, (size_t)256), classifyBatchSize);
+			auto end = (std::min)(token_set->size(), i + classify_batch);
+			auto chunk = (std::max)(classifyChunkSize, (size_t)1);
+			auto classify = [this, i, end, chunk](size_t c)
+			{
+				auto last = (std::min)(end, i + (c + 1) * chunk);
+				for (auto j = i + c * chunk; j < last; ++j)
+				{
+					try
+					{
+						token_syms[j] = TokenToTerminator((*token_set)[j]);
+						sym_epochs[j] = sym_epoch;
+					}
+					catch (...) {}
+				}
+			};
+			auto count = (end - i + chunk - 1) / chunk;
+			if (count > 1) ThreadPool::Global().ParallelFor(count, classify);
+			else classify(0);
+			classified_end = end;
+		}
+
+		// every token is classified again before the parser reads it
+		void InvalidateTerminators()
+		{
+			if (++sym_epoch == 0)
+			{
+				std::fill(sym_epochs.begin(), sym_epochs.end(), 0);
+				sym_epoch = 1;
+			}
+		}
+
+		void PrepareParser()
+		{
+			if (!grammar.NontermCount()) Build();
+			else my_parser.Reset();
+			parse_result.reset();
+			ClearErrors();
+		}
+
+		// keeps the accepted value for TakeParseResult, the other values go back to the pool
+		bool FinishParse(bool accepted)
+		{
+			auto& values = my_parser.semantic_stack;
+			if (accepted && values.size() && values.back()) parse_result = std::move(*values.back());
+			values.clear();
+			semantic_pool.Reset();
+			return accepted;
+		}
+
+		template<class TransferAt>
+		bool RunParser(size_t start_token, TransferAt&& transfer_at)
+		{
+			my_parser.SetStartTokenPointer(start_token);
+			return my_parser.Run(std::forward<TransferAt>(transfer_at),
+				[this](Span<std::any*> input, size_t nonterm, size_t pro_index, size_t token_iter)
+				{
+					return SemanticActionDispatcher(input, nonterm, pro_index, token_iter);
+				},
+				[this](std::vector<Sym> expects, size_t token_iter)
+				{
+					ErrorReductionActionDispatcher(expects, token_iter);
+				}, log);
+		}
+
 		Term& CreateWildTerminator(const std::string& name)
 		{
 			auto tmp = new Term;
 			tmp->name = name;
+			tmp->wild = true;
 			terminator_rules.push_back(tmp);
 			wild_terminators.push_back(tmp);
 			return *tmp;
@@ -333,22 +683,23 @@ namespace MuCplGen
 			try
 			{
 				if (generation_option == BuildOption::Runtime)
-					my_parser.SetUp(production_table, end - 1, end, epsilon, start);
+					my_parser.SetUp(grammar, end - 1, end, epsilon, start);
 				else
 				{
 					if ((int)generation_option & (int)BuildOption::Load && !Load(storage))
 					{
-						my_parser.SetUp(production_table, end - 1, end, epsilon, start);
+						my_parser.SetUp(grammar, end - 1, end, epsilon, start);
 						if ((int)generation_option & (int)BuildOption::Save) Save(storage);
 					}
 					else if (generation_option == BuildOption::Save)
 					{
-						my_parser.SetUp(production_table, end - 1, end, epsilon, start);
+						my_parser.SetUp(grammar, end - 1, end, epsilon, start);
 						Save(storage);
 					}
 				}
 				my_parser.Reset();
 				my_parser.debug_option = debug_option;
+				if (debug_option & DebugOption::ShowParseTableSize) my_parser.ReportParseTable(log);
 				build_error = false;
 			}
 			catch (PDABuildConflict conf)
@@ -368,13 +719,13 @@ namespace MuCplGen
 				log << "Related production:" << std::endl;
 				if (conf.head != -1)
 				{
-					PrintProduction(conf.head, production_table[conf.head][conf.production_index]);
+					PrintProduction(conf.head, grammar.Body(conf.head, conf.production_index));
 					PrintUpperRelativeProductions(conf.head);
 				}
 
 				if (conf.sym_production_index != -1)
 				{
-					PrintProduction(conf.sym, production_table[conf.sym][conf.sym_production_index]);
+					PrintProduction(conf.sym, grammar.Body(conf.sym, conf.sym_production_index));
 					PrintUpperRelativeProductions(conf.sym);
 				}
 
@@ -393,55 +744,124 @@ namespace MuCplGen
 			if (build_error) throw(Exception("Build Fail! Check conflict info in Log"));
 		}
 
-		void Save(const std::string& path) { my_parser.Save(path); }
+		void Save(const std::string& path) { my_parser.Save(path, grammar.Hash()); }
+
+		// false if the stored table is built from another grammar
+		bool Load(const std::string& path) { return my_parser.Load(path, grammar.Hash()); }
 
-		bool Load(const std::string& path) { return my_parser.Load(path); }
+		// names of the terminators the parser takes where the last parse stopped, e.g. to complete a partial input
+		std::vector<std::string> ExpectedTerminators() const
+		{
+			std::vector<std::string> names;
+			for (auto sym : my_parser.ExpectedSymbols())
+				if (sym < sym_to_name.size()) names.push_back(sym_to_name[sym]);
+			return names;
+		}
 
 		bool Parse(std::vector<LineContent>& input_text, TokenSet& token_set, size_t start_token = 0)
 		{
 			this->input_text = &input_text;
-			this->token_set = &token_set;
-			if (!production_table.size()) Build();
-			else my_parser.Reset();
-			my_parser.SetStartTokenPointer(start_token);
-			return my_parser.Parse(token_set,
-				[this](const Token& token) {return TokenToTerminator(token); },
-				[this](std::vector<std::any*> input, size_t nonterm, size_t pro_index, size_t token_iter)
-				{
-					return SemanticActionDispatcher(input, nonterm, pro_index, token_iter);
-				},
-				[this](std::vector<Sym> expects, size_t token_iter)
+			this->input_source.reset();
+			this->token_colors = nullptr;
+			return ParseTokens(token_set, start_token);
+		}
+
+		// tokens scanned from source, the source is used to highlight errors
+		// token_colors is the color side table of CompactToken (ScannResult::colors)
+		bool Parse(std::shared_ptr<const InputSource> source, TokenSet& token_set, size_t start_token = 0,
+			const std::vector<ConsoleForegroundColor>* token_colors = nullptr)
+		{
+			this->input_text = nullptr;
+			this->input_source = std::move(source);
+			this->token_colors = token_colors;
+			return ParseTokens(token_set, start_token);
+		}
+
+		// parse the tokens of Scanner::ScannSource
+		bool Parse(ScannResult<Token>& scann_result, size_t start_token = 0)
+		{
+			return Parse(scann_result.source, scann_result.tokens, start_token, &scann_result.colors);
+		}
+
+		// name of a token, a CompactToken is looked up in the source being parsed
+		std::string_view TokenText(const Token& token) const
+		{
+			if constexpr (std::is_same_v<Token, CompactToken>)
+				return input_source ? token.Text(*input_source) : std::string_view();
+			else return token.name;
+		}
+
+		// tokens are scanned as the parser shifts, only a window of them is kept (TokenStream::rewindSize)
+		bool Parse(TokenStream<Token>& token_stream, size_t start_token = 0)
+		{
+			this->input_text = nullptr;
+			this->input_source = token_stream.Source();
+			this->token_colors = nullptr;
+			this->token_set = nullptr;
+			this->token_stream = &token_stream;
+			PrepareParser();
+			return FinishParse(RunParser(start_token, [this](size_t i)
 				{
-					ErrorReductionActionDispatcher(expects, token_iter);
-				}, log);
+					return this->token_stream->Has(i) ? TokenToTerminator(this->token_stream->At(i)) : my_parser.no_token;
+				}));
+		}
+
+		// the tokens may be changed through it (e.g. retagged), so they are all classified again
+		TokenSet& GetTokenSet()
+		{
+			if (!token_set) throw(Exception("No token vector while parsing a TokenStream, use GetTokenStream()"));
+			InvalidateTerminators();
+			return *token_set;
+		}
+
+		TokenStream<Token>& GetTokenStream()
+		{
+			if (!token_stream) throw(Exception("Not parsing a TokenStream, use GetTokenSet()"));
+			return *token_stream;
 		}
 
-		TokenSet& GetTokenSet() { return *token_set; }
+		// token i of the token vector or the TokenStream being parsed, it is classified again if the parser reads it
+		Token& TokenAt(size_t i)
+		{
+			if (token_stream) return token_stream->At(i);
+			if (i < sym_epochs.size()) sym_epochs[i] = 0;
+			return (*token_set)[i];
+		}
 
 		size_t TokenIter() { return token_iter; }
 
 		void SetTokenPointerForParser(size_t i) { my_parser.ModifyTokenPointer(i); }
 
-		Token& CurrentToken() { return (*token_set)[token_iter]; }
+		Token& CurrentToken() { return TokenAt(token_iter); }
 
 		std::vector<LineContent>& GetInputText() { return *input_text; }
 
+		// null unless parsing tokens scanned from an InputSource
+		const std::shared_ptr<const InputSource>& GetInputSource() { return input_source; }
+
 		template<class T>
 		T GetErrorData(ParserErrorData* error) { return std::any_cast<T>(error->data); }
 
-		bool HasSemanticError(std::vector<std::any*> input)
+		bool HasSemanticError(SemanticValues input)
 		{
 			auto next = -1;
 			return NextSemanticError(input, next);
 		}
 
+		bool HasSemanticError(const std::vector<std::any*>& input) { return HasSemanticError(SemanticValues(input)); }
+
 		/*
 		usage:
 		int next = -1;
 		while(true)
 		{ auto data = NextSemanticError(input, next); ... if(!data) break;}
 		*/
-		MU_NOINLINE ParserErrorData* NextSemanticError(std::vector<std::any*> input, int& next)
+		ParserErrorData* NextSemanticError(const std::vector<std::any*>& input, int& next)
+		{
+			return NextSemanticError(SemanticValues(input), next);
+		}
+
+		MU_NOINLINE ParserErrorData* NextSemanticError(SemanticValues input, int& next)
 		{
 			auto first = next + 1;
 			auto size = input.size();
@@ -471,6 +891,13 @@ namespace MuCplGen
 
 		size_t debug_option = 0;
 
+		// classify the tokens of a vector into terminators up to classifyBatchSize ahead of the parser,
+		// in chunks of classifyChunkSize run on ThreadPool::Global()
+		// only set it if your translations may run concurrently
+		bool parallelClassify = false;
+		size_t classifyBatchSize = 1 << 16;
+		size_t classifyChunkSize = 1 << 14;
+
 		BuildOption generation_option = BuildOption::Runtime;
 
 		void SetStorage(const std::string& storage) { this->storage = storage; }
@@ -480,7 +907,9 @@ namespace MuCplGen
 		template<class Par>
 		void SubParse(SyntaxDirected<Par>& sub_parser)
 		{
-			sub_parser.Parse(GetInputText(), GetTokenSet(), TokenIter());
+			if (token_stream) sub_parser.Parse(*token_stream, TokenIter());
+			else if (input_source) sub_parser.Parse(input_source, *token_set, TokenIter(), token_colors);
+			else sub_parser.Parse(GetInputText(), *token_set, TokenIter());
 			SetTokenPointerForParser(sub_parser.TokenIter());
 		}
 
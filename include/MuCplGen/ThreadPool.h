@@ -0,0 +1,128 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <exception>
+#include <algorithm>
+#include "Platform.h"
+
+namespace MuCplGen
+{
+	// fixed worker threads running ParallelFor batches
+	// the calling thread works on its own batch too, so nested ParallelFor never deadlocks
+	class ThreadPool
+	{
+	public:
+		// thread_count counts the calling thread, 1 means everything runs on the caller
+		explicit ThreadPool(size_t thread_count = std::thread::hardware_concurrency())
+		{
+			if (thread_count == 0) thread_count = 1;
+			for (size_t i = 1; i < thread_count; ++i)
+				workers.emplace_back([this]() { WorkerLoop(); });
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stop = true;
+			}
+			wake.notify_all();
+			for (auto& worker : workers) worker.join();
+		}
+
+		size_t ThreadCount() const { return workers.size() + 1; }
+
+		// run body(i) for every i in [0, count), returns when all are done
+		// the first exception thrown by body is rethrown here
+		template<class Body>
+		void ParallelFor(size_t count, Body&& body)
+		{
+			if (count == 0) return;
+			if (count == 1 || workers.empty())
+			{
+				for (size_t i = 0; i < count; ++i) body(i);
+				return;
+			}
+			auto batch = std::make_shared<Batch>();
+			batch->count = count;
+			batch->body = [&body](size_t i) { body(i); };
+			auto helpers = (std::min)(workers.size(), count - 1);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				for (size_t i = 0; i < helpers; ++i) batches.push_back(batch);
+			}
+			if (helpers == workers.size()) wake.notify_all();
+			else for (size_t i = 0; i < helpers; ++i) wake.notify_one();
+			Work(*batch);
+			{
+				std::unique_lock<std::mutex> lock(batch->mutex);
+				batch->finished.wait(lock, [&]() { return batch->done == batch->count; });
+			}
+			if (batch->error) std::rethrow_exception(batch->error);
+		}
+
+		// shared by the parallel scanner and parser stages
+		static ThreadPool& Global()
+		{
+			static ThreadPool pool;
+			return pool;
+		}
+
+	private:
+		struct Batch
+		{
+			std::function<void(size_t)> body;
+			size_t count = 0;
+			std::atomic<size_t> next{ 0 };
+			size_t done = 0;
+			std::exception_ptr error;
+			std::mutex mutex;
+			std::condition_variable finished;
+		};
+
+		static void Work(Batch& batch)
+		{
+			size_t i;
+			while ((i = batch.next++) < batch.count)
+			{
+				std::exception_ptr error;
+				try { batch.body(i); }
+				catch (...) { error = std::current_exception(); }
+				std::lock_guard<std::mutex> lock(batch.mutex);
+				if (error && !batch.error) batch.error = error;
+				if (++batch.done == batch.count) batch.finished.notify_all();
+			}
+		}
+
+		void WorkerLoop()
+		{
+			while (true)
+			{
+				std::shared_ptr<Batch> batch;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					wake.wait(lock, [this]() { return stop || !batches.empty(); });
+					if (stop) return;
+					batch = std::move(batches.front());
+					batches.pop_front();
+				}
+				Work(*batch);
+			}
+		}
+
+		std::vector<std::thread> workers;
+		std::deque<std::shared_ptr<Batch>> batches;
+		std::mutex mutex;
+		std::condition_variable wake;
+		bool stop = false;
+	};
+}
@@ -1,58 +1,101 @@
 #pragma once
 #include <ostream>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <shared_mutex>
+#include <cstdint>
+#include "InputSource.h"
 
 namespace MuCplGen
 {
-	struct BaseToken
+	// token types by dense integer ids, shared by all scanners and threads
+	// id 0 is the empty type of a token never typed
+	class TokenTypeRegistry
 	{
-		template<class T>
-		friend class Scanner;
+	public:
+		using Id = uint32_t;
 
-		std::string name;
-		size_t line = 0;
-		size_t start = 0;
-		size_t end = 0;
-		size_t length() { return end - start + 1; }
-		constexpr size_t GetHash(const char* str) const
+		// id of name, registered on the first call
+		static Id Register(const std::string& name)
 		{
-			if (!*str)
-				return 0;
-			size_t hash = 5381;
-			while (size_t ch = (size_t)*str++)
+			auto& registry = Instance();
 			{
-				hash += (hash << 5) + ch;
-				return hash;
+				std::shared_lock<std::shared_mutex> lock(registry.mutex);
+				auto iter = registry.ids.find(name);
+				if (iter != registry.ids.end()) return iter->second;
 			}
-			return 0;
-		}
-		
-		void Type(const std::string& type)
-		{
-			this->type_name = type;
-			hash = GetHash(type.c_str());
+			std::unique_lock<std::shared_mutex> lock(registry.mutex);
+			auto iter = registry.ids.find(name);
+			if (iter != registry.ids.end()) return iter->second;
+			auto id = (Id)registry.names.size();
+			registry.names.push_back(name);
+			registry.ids.emplace(name, id);
+			return id;
 		}
 
-		const std::string& Type() const
+		static const std::string& Name(Id id)
 		{
-			return type_name;
+			auto& registry = Instance();
+			std::shared_lock<std::shared_mutex> lock(registry.mutex);
+			return registry.names[id];
 		}
 
-		virtual bool SameTypeAs(const BaseToken& r) const
+	private:
+		TokenTypeRegistry() { names.push_back(""); ids.emplace("", 0); }
+
+		static TokenTypeRegistry& Instance()
 		{
-			if (hash == r.hash) return type_name == r.type_name;
-			else return false;
+			static TokenTypeRegistry registry;
+			return registry;
 		}
 
+		std::shared_mutex mutex;
+		// deque keeps the names in place, Name() returns references
+		std::deque<std::string> names;
+		std::unordered_map<std::string, Id> ids;
+	};
+
+	// Text is the type of token name:
+	// std::string owns a copy of the lexeme,
+	// std::string_view refers into the source kept by ScannResult
+	template<class Text>
+	struct BasicToken
+	{
+		using TextType = Text;
+
+		template<class T>
+		friend class Scanner;
+
+		Text name;
+		size_t line = 0;
+		size_t start = 0;
+		size_t end = 0;
+		size_t length() { return end - start + 1; }
+		
+		void Type(const std::string& type) { type_id = TokenTypeRegistry::Register(type); }
+
+		const std::string& Type() const { return TokenTypeRegistry::Name(type_id); }
+
+		// the registered id of Type(), use it to compare types
+		TokenTypeRegistry::Id TypeId() const { return type_id; }
+
+		void TypeId(TokenTypeRegistry::Id id) { type_id = id; }
+
+		virtual bool SameTypeAs(const BasicToken& r) const { return type_id == r.type_id; }
+
 		bool IsEndToken() const { return end_of_tokens; }
 
-		friend std::ostream& operator << (std::ostream& os, const BaseToken& token)
+		friend std::ostream& operator << (std::ostream& os, const BasicToken& token)
 		{
 			os << "basic_token:" << std::endl;
 			if (token.IsEndToken()) os << "END TOKEN" << std::endl;
 			else
 			{
-				os << "type_name:" << token.type_name << std::endl;
+				os << "type_name:" << token.Type() << std::endl;
 				os << "name:" << token.name << std::endl;
 				os << "line:" << token.line << std::endl;
 				os << "start:" << token.start << std::endl;
@@ -60,10 +103,66 @@ namespace MuCplGen
 			}
 			return os;
 		}
-	protected:
-		std::string type_name;
 	private:
+		TokenTypeRegistry::Id type_id = 0;
 		bool end_of_tokens = false;
-		size_t hash = 0;
 	};
+
+	using BaseToken = BasicToken<std::string>;
+	using ViewToken = BasicToken<std::string_view>;
+
+	// 16 bytes and trivially copyable, made by Scanner::ScannCompact
+	// text, line and column are looked up in the InputSource the token is scanned from
+	struct CompactToken
+	{
+		static constexpr uint16_t end_flag = 1;
+
+		uint32_t offset = 0;
+		uint32_t length = 0;
+		TokenTypeRegistry::Id type_id = 0;
+		// sub type of the scanner, e.g. EasyTokenType of EasyScanner
+		uint16_t kind = 0;
+		uint16_t flags = 0;
+
+		const std::string& Type() const { return TokenTypeRegistry::Name(type_id); }
+		TokenTypeRegistry::Id TypeId() const { return type_id; }
+		bool SameTypeAs(const CompactToken& r) const { return type_id == r.type_id; }
+
+		template<class Kind>
+		Kind KindAs() const { return static_cast<Kind>(kind); }
+
+		bool IsEndToken() const { return flags & end_flag; }
+
+		std::string_view Text(const InputSource& source) const { return source.Text().substr(offset, length); }
+		size_t Line(const InputSource& source) const { return source.FirstLineNo() + source.LineOf(offset); }
+		size_t Column(const InputSource& source) const { return offset - source.LineBegin(source.LineOf(offset)); }
+
+		friend std::ostream& operator << (std::ostream& os, const CompactToken& token)
+		{
+			os << "compact_token:" << std::endl;
+			if (token.IsEndToken()) os << "END TOKEN" << std::endl;
+			else
+			{
+				os << "type_name:" << token.Type() << std::endl;
+				os << "offset:" << token.offset << std::endl;
+				os << "length:" << token.length << std::endl;
+			}
+			return os;
+		}
+	};
+	static_assert(sizeof(CompactToken) == 16, "CompactToken should be 16 bytes");
+	static_assert(std::is_trivially_copyable_v<CompactToken>, "CompactToken should be trivially copyable");
+
+	template<class T, class = void>
+	struct IsToken : std::false_type {};
+
+	template<class T>
+	struct IsToken<T, std::void_t<typename T::TextType>>
+		: std::is_base_of<BasicToken<typename T::TextType>, T> {};
+
+	template<>
+	struct IsToken<CompactToken> : std::true_type {};
+
+	template<class T>
+	constexpr bool IsToken_v = IsToken<T>::value;
 }
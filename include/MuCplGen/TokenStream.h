@@ -0,0 +1,107 @@
+#pragma once
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <string>
+#include <algorithm>
+#include "InputSource.h"
+#include "MuException.h"
+
+namespace MuCplGen
+{
+	// tokens pulled on demand, e.g. from Scanner::ScannStream
+	// only a window of tokens is kept: everything after the furthest token asked for is not scanned yet,
+	// and tokens more than rewindSize before it are released
+	// tokens are indexed as in a token vector, references stay valid until the token is released
+	template<class Token>
+	class TokenStream
+	{
+	public:
+		// appends the next tokens, returns false once the end token is appended
+		using Pull = std::function<bool(std::vector<Token>&)>;
+
+		TokenStream(Pull pull, std::shared_ptr<const InputSource> source = nullptr)
+			: pull(std::move(pull)), source(std::move(source)) {}
+
+		// tokens kept before the furthest token asked for, SetTokenPointerForParser may rewind this far
+		size_t rewindSize = 256;
+
+		// false if i is after the end token
+		bool Has(size_t i)
+		{
+			while (i >= base + window.size() && !exhausted) PullMore();
+			return i < base + window.size();
+		}
+
+		Token& At(size_t i)
+		{
+			if (i < base)
+				throw(Exception("Token " + std::to_string(i) + " was released, it is more than "
+					+ std::to_string(rewindSize) + " tokens back (TokenStream::rewindSize)"));
+			if (!Has(i)) throw(Exception("Token " + std::to_string(i) + " is after the end token"));
+			if (i > furthest)
+			{
+				furthest = i;
+				Release();
+			}
+			return window[i - base];
+		}
+
+		Token& operator[](size_t i) { return At(i); }
+
+		// index of the first token still kept
+		size_t Base() const { return base; }
+
+		// index after the last token scanned so far
+		size_t Buffered() const { return base + window.size(); }
+
+		// the most tokens kept at once
+		size_t PeakWindow() const { return peak_window; }
+
+		// runs on every token as it is pulled, e.g. to retag identifiers declared as types
+		void OnPull(std::function<void(Token&)> hook) { on_pull = std::move(hook); }
+
+		// f(index, token) for the tokens from index from that are already pulled
+		template<class F>
+		void ForEachBuffered(size_t from, F&& f)
+		{
+			for (auto i = (std::max)(from, base); i < base + window.size(); ++i) f(i, window[i - base]);
+		}
+
+		const std::shared_ptr<const InputSource>& Source() const { return source; }
+
+	private:
+		void PullMore()
+		{
+			pulled.clear();
+			exhausted = !pull(pulled);
+			for (auto& token : pulled)
+			{
+				if (on_pull) on_pull(token);
+				window.push_back(std::move(token));
+			}
+			peak_window = (std::max)(peak_window, window.size());
+		}
+
+		void Release()
+		{
+			while (window.size() && base + rewindSize < furthest)
+			{
+				window.pop_front();
+				++base;
+			}
+		}
+
+		Pull pull;
+		std::shared_ptr<const InputSource> source;
+		std::function<void(Token&)> on_pull;
+		// deque: pulling and releasing never move the tokens kept
+		std::deque<Token> window;
+		std::vector<Token> pulled;
+		size_t base = 0;
+		size_t furthest = 0;
+		size_t peak_window = 0;
+		bool exhausted = false;
+	};
+}